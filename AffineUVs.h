@@ -0,0 +1,186 @@
+#pragma once
+
+#include "CPUFeatures.h"
+#include "Images.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include <vector>
+
+// Making the uvs of a row of pixels for an affine uv transform, without a vector matrix multiply per pixel.
+//
+// With an affine transform, the uv changes by the same d_uv_dx from one pixel to the next, and by the same
+// d_uv_dy from one row to the next. So a row's uvs start from the uv of its first pixel, and each pixel adds
+// d_uv_dx to the one before it. This is done 8 pixels at a time with AVX, where the 8 lanes start at the first
+// 8 uvs and all step 8 pixels each time.
+//
+// Every add rounds a little, and the rounding builds up the further a run of adds goes. So the uv is worked
+// out directly again every c_affineUVAnchorInterval pixels, which keeps the drift to a few float ulps of the
+// uv. MeasureAffineUVError() compares against the per pixel vector matrix multiply, to check that it is.
+//
+// The AVX and scalar versions do the same adds in the same order, so they make the same uvs.
+//
+// Axis aligned transforms, like translations and scales, don't step at all. Their u only depends on x and
+// their v only on y, so the uvs of the first row and the first column, made with the same vector matrix
+// multiply as the per pixel path, are the uvs of every pixel, and come out exactly the same as it.
+
+// how many pixels go between working out the uv directly. A multiple of 8.
+static const int c_affineUVAnchorInterval = 64;
+
+// An affine transform from the percents of pixel centers (see PixelToUV()) to uvs, as steps in pixels
+struct AffineUVs
+{
+    Vector2 origin;   // the uv at the center of pixel (0, 0)
+    Vector2 d_uv_dx;
+    Vector2 d_uv_dy;
+
+    // for axis aligned transforms, the u of each column and the v of each row
+    bool axisAligned = false;
+    std::vector<float> columnU;
+    std::vector<float> rowV;
+
+    Vector2 UV(int x, int y) const
+    {
+        return Vector2
+        {
+            origin[0] + float(y) * d_uv_dy[0] + float(x) * d_uv_dx[0],
+            origin[1] + float(y) * d_uv_dy[1] + float(x) * d_uv_dx[1]
+        };
+    }
+};
+
+// whether the transform is affine, so that [x, y, 1] * uvtransform always has 1 for its third component
+inline bool IsAffine(const Matrix33& uvtransform)
+{
+    return uvtransform[0][2] == 0.0f && uvtransform[1][2] == 0.0f && uvtransform[2][2] == 1.0f;
+}
+
+// For a transform of percents like TestMipMatrix uses, with the image being width x height pixels
+inline AffineUVs MakeAffineUVs(const Matrix33& uvtransform, int width, int height)
+{
+    AffineUVs ret;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        ret.d_uv_dx[axis] = uvtransform[0][axis] / float(width);
+        ret.d_uv_dy[axis] = uvtransform[1][axis] / float(height);
+        ret.origin[axis] = PixelToUV(0, width) * uvtransform[0][axis] + PixelToUV(0, height) * uvtransform[1][axis] + uvtransform[2][axis];
+    }
+
+    // With a 0 there, y adds exactly nothing to u, and x adds exactly nothing to v, so the first row and
+    // column hold the uvs for every pixel.
+    ret.axisAligned = uvtransform[1][0] == 0.0f && uvtransform[0][1] == 0.0f;
+    if (ret.axisAligned)
+    {
+        ret.columnU.resize(width);
+        ret.rowV.resize(height);
+
+        Vector3 percent = { 0.0f, PixelToUV(0, height), 1.0f };
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
+            ret.columnU[x] = (percent * uvtransform)[0];
+        }
+
+        percent[0] = PixelToUV(0, width);
+        for (int y = 0; y < height; ++y)
+        {
+            percent[1] = PixelToUV(y, height);
+            ret.rowV[y] = (percent * uvtransform)[1];
+        }
+    }
+    return ret;
+}
+
+// count uvs stepping from the anchor uv, which is the uv of the first one
+inline void StepAffineUVs(const Vector2& anchor, const Vector2& d_uv_dx, float* u, float* v, int count)
+{
+    alignas(32) float laneU[8];
+    alignas(32) float laneV[8];
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        laneU[lane] = anchor[0] + float(lane) * d_uv_dx[0];
+        laneV[lane] = anchor[1] + float(lane) * d_uv_dx[1];
+    }
+    float stepU = 8.0f * d_uv_dx[0];
+    float stepV = 8.0f * d_uv_dx[1];
+
+    if (GetSIMDLevel() >= SIMDLevel::AVX2)
+    {
+        __m256 u8 = _mm256_load_ps(laneU);
+        __m256 v8 = _mm256_load_ps(laneV);
+        __m256 stepU8 = _mm256_set1_ps(stepU);
+        __m256 stepV8 = _mm256_set1_ps(stepV);
+
+        int index = 0;
+        for (; index + 8 <= count; index += 8)
+        {
+            _mm256_storeu_ps(&u[index], u8);
+            _mm256_storeu_ps(&v[index], v8);
+            u8 = _mm256_add_ps(u8, stepU8);
+            v8 = _mm256_add_ps(v8, stepV8);
+        }
+
+        // the last partial group
+        _mm256_store_ps(laneU, u8);
+        _mm256_store_ps(laneV, v8);
+        std::copy(laneU, laneU + (count - index), &u[index]);
+        std::copy(laneV, laneV + (count - index), &v[index]);
+        return;
+    }
+
+    for (int index = 0; index < count; index += 8)
+    {
+        for (int lane = 0; lane < 8 && index + lane < count; ++lane)
+        {
+            u[index + lane] = laneU[lane];
+            v[index + lane] = laneV[lane];
+            laneU[lane] += stepU;
+            laneV[lane] += stepV;
+        }
+    }
+}
+
+// The uvs of count pixels of row y, starting at pixel xBegin. The uv is worked out directly at xBegin and then
+// every c_affineUVAnchorInterval pixels after it, so the same pixel can get slightly different uvs if a row is
+// split up differently. Axis aligned transforms just copy from the tables, and don't have that problem.
+inline void MakeAffineRowUVs(const AffineUVs& affine, int y, int xBegin, int count, float* u, float* v)
+{
+    if (affine.axisAligned)
+    {
+        std::copy(&affine.columnU[xBegin], &affine.columnU[xBegin] + count, u);
+        std::fill(v, v + count, affine.rowV[y]);
+        return;
+    }
+
+    for (int anchorIndex = 0; anchorIndex < count; anchorIndex += c_affineUVAnchorInterval)
+    {
+        int runCount = std::min(c_affineUVAnchorInterval, count - anchorIndex);
+        StepAffineUVs(affine.UV(xBegin + anchorIndex, y), affine.d_uv_dx, &u[anchorIndex], &v[anchorIndex], runCount);
+    }
+}
+
+// The largest difference on each axis between the uvs MakeAffineRowUVs() makes for whole rows, and the uvs from
+// multiplying each pixel's percent by the transform
+inline Vector2 MeasureAffineUVError(const AffineUVs& affine, const Matrix33& uvtransform, int width, int height)
+{
+    std::vector<float> rowU(width);
+    std::vector<float> rowV(width);
+
+    Vector2 ret = { 0.0f, 0.0f };
+    Vector3 percent = { 0.0f, 0.0f, 1.0f };
+    for (int y = 0; y < height; ++y)
+    {
+        MakeAffineRowUVs(affine, y, 0, width, rowU.data(), rowV.data());
+
+        percent[1] = PixelToUV(y, height);
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
+            Vector3 uv3 = percent * uvtransform;
+            ret[0] = std::max(ret[0], std::fabsf(rowU[x] - uv3[0]));
+            ret[1] = std::max(ret[1], std::fabsf(rowV[x] - uv3[1]));
+        }
+    }
+    return ret;
+}
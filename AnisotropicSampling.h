@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Images.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Anisotropic filtering.
+//
+// When a pixel covers a long thin area of the texture, like with a non uniform scale or a surface seen at a
+// grazing angle, picking the mip from the longer axis blurs the short axis, and picking it from the shorter
+// axis aliases along the long one. This picks the mip from the shorter (minor) axis instead, and covers the
+// longer (major) axis by averaging several taps spaced out along it.
+//
+// The number of taps is limited by a budget of bilinear fetches, so the cost stays bounded. A trilinear tap
+// costs two of them. When the budget runs out before the major axis is covered, the mip goes up until the
+// taps do cover it, which blurs instead of aliasing. The default budget of 16 gives 16x anisotropy with
+// bilinear taps, and 8x with trilinear ones.
+
+static const int c_anisotropicMaxFetches = 16;
+
+// Sums of taps are kept in floats, in whatever color space the samplers filter in
+inline RGBF32 AnisotropicTapToSum(const RGBU8& tap)
+{
+    RGBF32 ret;
+    ret.r = float(tap.r);
+    ret.g = float(tap.g);
+    ret.b = float(tap.b);
+    return ret;
+}
+
+inline RGBF32 AnisotropicTapToSum(const RGBF32& tap)
+{
+    return tap;
+}
+
+inline void AnisotropicSumToTap(const RGBF32& sum, RGBU8& tap)
+{
+    tap.r = uint8(sum.r + 0.5f);
+    tap.g = uint8(sum.g + 0.5f);
+    tap.b = uint8(sum.b + 0.5f);
+}
+
+inline void AnisotropicSumToTap(const RGBF32& sum, RGBF32& tap)
+{
+    tap = sum;
+}
+
+// how many bilinear fetches each tap of a filter costs
+template <SampleType FILTER>
+inline int AnisotropicFetchesPerTap()
+{
+    return (FILTER == SampleType::LinearMip) ? 2 : 1;
+}
+
+// The taps and mip the anisotropic sampler uses for a pixel, given how its uv changes per pixel on x and y
+struct AnisotropicFootprint
+{
+    Vector2 majorAxis = { 0.0f, 0.0f };  // in uv units, spanning the whole footprint
+    int taps = 1;
+    float mip = 0.0f;
+};
+
+template <typename TEXEL>
+inline AnisotropicFootprint CalculateAnisotropicFootprint(const ImageMipsT<TEXEL>& texture, const Vector2& d_uv_dx, const Vector2& d_uv_dy, int maxTaps)
+{
+    // the lengths of the axes are measured in texels of mip 0
+    Vector2 texelsPerUV = { float(texture[0].width), float(texture[0].height) };
+    Vector2 d_texel_dx = { d_uv_dx[0] * texelsPerUV[0], d_uv_dx[1] * texelsPerUV[1] };
+    Vector2 d_texel_dy = { d_uv_dy[0] * texelsPerUV[0], d_uv_dy[1] * texelsPerUV[1] };
+    float lenx = std::sqrtf(Dot(d_texel_dx, d_texel_dx));
+    float leny = std::sqrtf(Dot(d_texel_dy, d_texel_dy));
+
+    AnisotropicFootprint ret;
+    ret.majorAxis = (lenx >= leny) ? d_uv_dx : d_uv_dy;
+    float majorLength = std::max(lenx, leny);
+    float minorLength = std::min(lenx, leny);
+
+    // a tap per texel of the minor axis length along the major axis, as far as the budget allows
+    float anisotropy = majorLength / std::max(minorLength, 1e-6f);
+    ret.taps = clamp(int(std::ceilf(anisotropy - 1e-3f)), 1, std::max(maxTaps, 1));
+
+    float footprint = std::max(minorLength, majorLength / float(ret.taps));
+    ret.mip = clamp(std::log2f(std::max(footprint, 1e-6f)), 0.0f, float(texture.size() - 1));
+    return ret;
+}
+
+// Samples with up to maxFetches / AnisotropicFetchesPerTap<FILTER>() taps of the given filter along the
+// major axis. The derivatives are how the uv changes from one pixel to the next on x and on y.
+template <SampleType FILTER = SampleType::LinearMip, AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline typename TexelTraits<TEXEL>::Filtered SampleAnisotropic(const ImageMipsT<TEXEL>& texture, const Vector2& uv, const Vector2& d_uv_dx, const Vector2& d_uv_dy, int maxFetches = c_anisotropicMaxFetches)
+{
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    AnisotropicFootprint footprint = CalculateAnisotropicFootprint(texture, d_uv_dx, d_uv_dy, maxFetches / AnisotropicFetchesPerTap<FILTER>());
+    if (footprint.taps == 1)
+        return Sampler<FILTER, MODE, POW2>::Sample(texture, uv, footprint.mip);
+
+    // the taps are spread evenly over the major axis, centered on the uv
+    RGBF32 sum;
+    for (int tapIndex = 0; tapIndex < footprint.taps; ++tapIndex)
+    {
+        float offset = (float(tapIndex) + 0.5f) / float(footprint.taps) - 0.5f;
+        Vector2 tapUV = { uv[0] + footprint.majorAxis[0] * offset, uv[1] + footprint.majorAxis[1] * offset };
+        sum += AnisotropicTapToSum(Sampler<FILTER, MODE, POW2>::Sample(texture, tapUV, footprint.mip));
+    }
+    sum *= 1.0f / float(footprint.taps);
+
+    Filtered ret;
+    AnisotropicSumToTap(sum, ret);
+    return ret;
+}
@@ -0,0 +1,609 @@
+#pragma once
+
+#include "CPUFeatures.h"
+#include "Images.h"
+
+#include <algorithm>
+#include <immintrin.h>
+#include <limits.h>
+#include <type_traits>
+
+// Samplers that take a batch of UVs as separate u[] and v[] arrays and write a result for each, so a whole
+// row of pixels or a packet of rays can be sampled in one call.
+//
+// For RGBU8 mips there is an AVX2 path that does 8 samples at a time. The UV to pixel math, the wrapping
+// and the filtering are all done in SIMD, and texels are read with gathers. Each gather reads 4 bytes for a
+// 3 byte texel, which is fine because ImageMips storage always has padding after the last texel.
+// The results are the same as calling the single sample versions in Images.h, with the default wrap address
+// mode, for each sample.
+//
+// RGBF32 and RGBF16 mips have an AVX2 path for bilinear and trilinear sampling too. They gather each channel
+// as floats, converting halves with F16C, and filter with the same multiplies and adds as lerp() on RGBF32.
+//
+// Tiled texel layouts, recorded texel reads, and machines without AVX2, loop over the single sample versions.
+//
+// The batch versions that take per sample mips clamp them to the mip chain.
+
+//-------------------------------------------------------------------------------------------------------
+// AVX2 internals
+
+// the size and location of each mip, for gathering by mip index
+struct BatchMipTables
+{
+    alignas(32) int width[32];
+    alignas(32) int height[32];
+    alignas(32) int offset[32];
+    int lastMip = 0;
+    const uint8* data = nullptr;
+
+    // Returns false if the byte offsets don't fit in the 32 bit gather indices, or the mips aren't row major
+    template <typename TEXEL>
+    bool Setup(const ImageMipsT<TEXEL>& texture)
+    {
+        if (texture.empty() || texture.DataSize() > size_t(INT_MAX))
+            return false;
+        for (const ImageT<TEXEL>& image : texture)
+        {
+            if (image.layout != TexelLayout::RowMajor)
+                return false;
+        }
+
+        lastMip = int(texture.size()) - 1;
+        data = texture.Data();
+        for (int mipIndex = 0; mipIndex <= lastMip; ++mipIndex)
+        {
+            width[mipIndex] = texture[mipIndex].width;
+            height[mipIndex] = texture[mipIndex].height;
+            offset[mipIndex] = int(texture.Layout(mipIndex).offset);
+        }
+        return true;
+    }
+};
+
+struct BatchLevels8
+{
+    __m256i width;
+    __m256i height;
+    __m256i offset;
+};
+
+inline BatchLevels8 GatherLevels8(const BatchMipTables& tables, __m256i mipIndex)
+{
+    mipIndex = _mm256_min_epi32(_mm256_max_epi32(mipIndex, _mm256_setzero_si256()), _mm256_set1_epi32(tables.lastMip));
+
+    BatchLevels8 ret;
+    ret.width = _mm256_i32gather_epi32(tables.width, mipIndex, 4);
+    ret.height = _mm256_i32gather_epi32(tables.height, mipIndex, 4);
+    ret.offset = _mm256_i32gather_epi32(tables.offset, mipIndex, 4);
+    return ret;
+}
+
+// value % size for pixel coordinates. The float divide can be off by one either way, which gets fixed up.
+// Negative values wrap around to positive ones.
+inline __m256i WrapCoordinate8(__m256i value, __m256i size)
+{
+    __m256i quotient = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(value), _mm256_cvtepi32_ps(size)));
+    __m256i ret = _mm256_sub_epi32(value, _mm256_mullo_epi32(quotient, size));
+    ret = _mm256_add_epi32(ret, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), ret), size));
+    ret = _mm256_sub_epi32(ret, _mm256_andnot_si256(_mm256_cmpgt_epi32(size, ret), size));
+    return ret;
+}
+
+// reads the texel at (x, y) of each lane's mip, as 0x00BBGGRR
+inline __m256i FetchTexels8(const BatchMipTables& tables, const BatchLevels8& levels, __m256i x, __m256i y)
+{
+    __m256i pixelIndex = _mm256_add_epi32(_mm256_mullo_epi32(y, levels.width), x);
+    __m256i byteOffset = _mm256_add_epi32(levels.offset, _mm256_mullo_epi32(pixelIndex, _mm256_set1_epi32(3)));
+    __m256i texels = _mm256_i32gather_epi32((const int*)tables.data, byteOffset, 1);
+    return _mm256_and_si256(texels, _mm256_set1_epi32(0x00FFFFFF));
+}
+
+// Same as lerp() on RGBU8, which truncates each term to 8 bits before adding them.
+inline __m256i LerpTexels8(__m256i a, __m256i b, __m256 t)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    __m256 oneMinusT = _mm256_sub_ps(_mm256_set1_ps(1.0f), t);
+
+    __m256i ret = _mm256_setzero_si256();
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        __m256 channelA = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(a, channel * 8), byteMask));
+        __m256 channelB = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(b, channel * 8), byteMask));
+        __m256i value = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(channelA, oneMinusT)), _mm256_cvttps_epi32(_mm256_mul_ps(channelB, t)));
+        ret = _mm256_or_si256(ret, _mm256_slli_epi32(_mm256_and_si256(value, byteMask), channel * 8));
+    }
+    return ret;
+}
+
+inline __m256i SampleNearest8(const BatchMipTables& tables, const BatchLevels8& levels, __m256 u, __m256 v)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i x = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(u, one), _mm256_cvtepi32_ps(levels.width))));
+    __m256i y = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(v, one), _mm256_cvtepi32_ps(levels.height))));
+    return FetchTexels8(tables, levels, WrapCoordinate8(x, levels.width), WrapCoordinate8(y, levels.height));
+}
+
+// BilinearTexels() for wrapping
+inline void BilinearCoordinates8(__m256 uv, __m256i size, __m256i& coord0, __m256i& coord1, __m256& fract)
+{
+    __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(uv, _mm256_set1_ps(1.0f)), _mm256_cvtepi32_ps(size)), _mm256_set1_ps(0.5f));
+    __m256 floorX = _mm256_floor_ps(x);
+    fract = _mm256_sub_ps(x, floorX);
+    coord0 = WrapCoordinate8(_mm256_cvttps_epi32(floorX), size);
+    coord1 = _mm256_add_epi32(coord0, _mm256_set1_epi32(1));
+    coord1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(coord1, size), coord1);
+}
+
+inline __m256i SampleBilinear8(const BatchMipTables& tables, const BatchLevels8& levels, __m256 u, __m256 v)
+{
+    __m256i x0, x1, y0, y1;
+    __m256 xweight, yweight;
+    BilinearCoordinates8(u, levels.width, x0, x1, xweight);
+    BilinearCoordinates8(v, levels.height, y0, y1, yweight);
+
+    __m256i p00 = FetchTexels8(tables, levels, x0, y0);
+    __m256i p10 = FetchTexels8(tables, levels, x1, y0);
+    __m256i p01 = FetchTexels8(tables, levels, x0, y1);
+    __m256i p11 = FetchTexels8(tables, levels, x1, y1);
+
+    __m256i px0 = LerpTexels8(p00, p10, xweight);
+    __m256i px1 = LerpTexels8(p01, p11, xweight);
+    return LerpTexels8(px0, px1, yweight);
+}
+
+inline __m256i SampleTrilinear8(const BatchMipTables& tables, __m256 u, __m256 v, __m256 mip)
+{
+    __m256i mipInt = _mm256_cvttps_epi32(mip);
+    __m256 mipFract = _mm256_sub_ps(mip, _mm256_round_ps(mip, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+
+    __m256i bilinearLowMip = SampleBilinear8(tables, GatherLevels8(tables, mipInt), u, v);
+    __m256i bilinearHighMip = SampleBilinear8(tables, GatherLevels8(tables, _mm256_add_epi32(mipInt, _mm256_set1_epi32(1))), u, v);
+    return LerpTexels8(bilinearLowMip, bilinearHighMip, mipFract);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// AVX2 internals for the linear texel formats. The 8 texels are held as a register per channel, as floats,
+// and filtered the same way lerp() does on RGBF32.
+
+struct LinearTexels8
+{
+    __m256 r;
+    __m256 g;
+    __m256 b;
+};
+
+// reads the texel at (x, y) of each lane's mip, as floats
+template <typename TEXEL>
+inline LinearTexels8 FetchLinearTexels8(const BatchMipTables& tables, const BatchLevels8& levels, __m256i x, __m256i y);
+
+template <>
+inline LinearTexels8 FetchLinearTexels8<RGBF32>(const BatchMipTables& tables, const BatchLevels8& levels, __m256i x, __m256i y)
+{
+    __m256i pixelIndex = _mm256_add_epi32(_mm256_mullo_epi32(y, levels.width), x);
+    __m256i byteOffset = _mm256_add_epi32(levels.offset, _mm256_mullo_epi32(pixelIndex, _mm256_set1_epi32(sizeof(RGBF32))));
+    const float* channels = (const float*)tables.data;
+
+    LinearTexels8 ret;
+    ret.r = _mm256_i32gather_ps(&channels[0], byteOffset, 1);
+    ret.g = _mm256_i32gather_ps(&channels[1], byteOffset, 1);
+    ret.b = _mm256_i32gather_ps(&channels[2], byteOffset, 1);
+    return ret;
+}
+
+// converts the half in the low 16 bits of each lane to a float
+inline __m256 HalvesToFloats8(__m256i halves)
+{
+    __m256i packed = _mm256_packus_epi32(halves, halves);
+    packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+}
+
+// Each texel is read as two 4 byte gathers, of r and g, and then of b and 2 bytes past it. The last texel
+// of a mip reads into the padding after it, like the RGBU8 gathers do.
+template <>
+inline LinearTexels8 FetchLinearTexels8<RGBF16>(const BatchMipTables& tables, const BatchLevels8& levels, __m256i x, __m256i y)
+{
+    __m256i pixelIndex = _mm256_add_epi32(_mm256_mullo_epi32(y, levels.width), x);
+    __m256i byteOffset = _mm256_add_epi32(levels.offset, _mm256_mullo_epi32(pixelIndex, _mm256_set1_epi32(sizeof(RGBF16))));
+    const __m256i lowHalf = _mm256_set1_epi32(0xFFFF);
+
+    __m256i rg = _mm256_i32gather_epi32((const int*)tables.data, byteOffset, 1);
+    __m256i b = _mm256_i32gather_epi32((const int*)&tables.data[4], byteOffset, 1);
+
+    LinearTexels8 ret;
+    ret.r = HalvesToFloats8(_mm256_and_si256(rg, lowHalf));
+    ret.g = HalvesToFloats8(_mm256_srli_epi32(rg, 16));
+    ret.b = HalvesToFloats8(_mm256_and_si256(b, lowHalf));
+    return ret;
+}
+
+inline LinearTexels8 LerpLinearTexels8(const LinearTexels8& a, const LinearTexels8& b, __m256 t)
+{
+    __m256 oneMinusT = _mm256_sub_ps(_mm256_set1_ps(1.0f), t);
+
+    LinearTexels8 ret;
+    ret.r = _mm256_add_ps(_mm256_mul_ps(a.r, oneMinusT), _mm256_mul_ps(b.r, t));
+    ret.g = _mm256_add_ps(_mm256_mul_ps(a.g, oneMinusT), _mm256_mul_ps(b.g, t));
+    ret.b = _mm256_add_ps(_mm256_mul_ps(a.b, oneMinusT), _mm256_mul_ps(b.b, t));
+    return ret;
+}
+
+// picks b in the lanes where the mask is set
+inline LinearTexels8 BlendLinearTexels8(const LinearTexels8& a, const LinearTexels8& b, __m256 mask)
+{
+    LinearTexels8 ret;
+    ret.r = _mm256_blendv_ps(a.r, b.r, mask);
+    ret.g = _mm256_blendv_ps(a.g, b.g, mask);
+    ret.b = _mm256_blendv_ps(a.b, b.b, mask);
+    return ret;
+}
+
+template <typename TEXEL>
+inline LinearTexels8 SampleNearestLinear8(const BatchMipTables& tables, const BatchLevels8& levels, __m256 u, __m256 v)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256i x = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(u, one), _mm256_cvtepi32_ps(levels.width))));
+    __m256i y = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(v, one), _mm256_cvtepi32_ps(levels.height))));
+    return FetchLinearTexels8<TEXEL>(tables, levels, WrapCoordinate8(x, levels.width), WrapCoordinate8(y, levels.height));
+}
+
+template <typename TEXEL>
+inline LinearTexels8 SampleBilinearLinear8(const BatchMipTables& tables, const BatchLevels8& levels, __m256 u, __m256 v)
+{
+    __m256i x0, x1, y0, y1;
+    __m256 xweight, yweight;
+    BilinearCoordinates8(u, levels.width, x0, x1, xweight);
+    BilinearCoordinates8(v, levels.height, y0, y1, yweight);
+
+    LinearTexels8 p00 = FetchLinearTexels8<TEXEL>(tables, levels, x0, y0);
+    LinearTexels8 p10 = FetchLinearTexels8<TEXEL>(tables, levels, x1, y0);
+    LinearTexels8 p01 = FetchLinearTexels8<TEXEL>(tables, levels, x0, y1);
+    LinearTexels8 p11 = FetchLinearTexels8<TEXEL>(tables, levels, x1, y1);
+
+    LinearTexels8 px0 = LerpLinearTexels8(p00, p10, xweight);
+    LinearTexels8 px1 = LerpLinearTexels8(p01, p11, xweight);
+    return LerpLinearTexels8(px0, px1, yweight);
+}
+
+template <typename TEXEL>
+inline LinearTexels8 SampleTrilinearLinear8(const BatchMipTables& tables, __m256 u, __m256 v, __m256 mip)
+{
+    __m256i mipInt = _mm256_cvttps_epi32(mip);
+    __m256 mipFract = _mm256_sub_ps(mip, _mm256_round_ps(mip, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+
+    LinearTexels8 bilinearLowMip = SampleBilinearLinear8<TEXEL>(tables, GatherLevels8(tables, mipInt), u, v);
+    LinearTexels8 bilinearHighMip = SampleBilinearLinear8<TEXEL>(tables, GatherLevels8(tables, _mm256_add_epi32(mipInt, _mm256_set1_epi32(1))), u, v);
+    return LerpLinearTexels8(bilinearLowMip, bilinearHighMip, mipFract);
+}
+
+// writes the 8 texels out as RGBF32
+inline void StoreLinearTexels8(RGBF32* out, const LinearTexels8& texels)
+{
+    alignas(32) float r[8];
+    alignas(32) float g[8];
+    alignas(32) float b[8];
+    _mm256_store_ps(r, texels.r);
+    _mm256_store_ps(g, texels.g);
+    _mm256_store_ps(b, texels.b);
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        out[lane].r = r[lane];
+        out[lane].g = g[lane];
+        out[lane].b = b[lane];
+    }
+}
+
+// writes the 8 texels out as 24 tightly packed bytes
+inline void StoreTexels8(RGBU8* out, __m256i texels)
+{
+    const __m256i packRGB = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    texels = _mm256_shuffle_epi8(texels, packRGB);
+
+    __m128i low = _mm256_castsi256_si128(texels);
+    __m128i high = _mm256_extracti128_si256(texels, 1);
+    uint8* bytes = &out[0].r;
+    int lowLast = _mm_extract_epi32(low, 2);
+    int highLast = _mm_extract_epi32(high, 2);
+    _mm_storel_epi64((__m128i*)&bytes[0], low);
+    memcpy(&bytes[8], &lowLast, 4);
+    _mm_storel_epi64((__m128i*)&bytes[12], high);
+    memcpy(&bytes[20], &highLast, 4);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Batch samplers
+
+inline int ClampMipIndex(int mipIndex, size_t mipCount)
+{
+    return clamp(mipIndex, 0, int(mipCount) - 1);
+}
+
+inline float ClampMip(float mip, size_t mipCount)
+{
+    return clamp(mip, 0.0f, float(mipCount - 1));
+}
+
+// Calls the lambda with std::true_type when the whole mip chain can use the POW2 wrapping and std::false_type
+// when it can't, so the loops below pick the sampler once per batch instead of once per sample.
+template <typename TEXEL, typename LAMBDA>
+inline void DispatchPowerOfTwo(const ImageMipsT<TEXEL>& texture, const LAMBDA& lambda)
+{
+    if (IsPowerOfTwo(texture))
+        lambda(std::true_type());
+    else
+        lambda(std::false_type());
+}
+
+template <typename TEXEL>
+inline void SampleNearestBatch(const ImageMipsT<TEXEL>& texture, int mipIndex, const float* u, const float* v, TEXEL* out, size_t count)
+{
+    const ImageT<TEXEL>& image = texture[ClampMipIndex(mipIndex, texture.size())];
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleNearest<AddressMode::Wrap, decltype(pow2)::value>(image, Vector2{ u[index], v[index] });
+    });
+}
+
+template <typename TEXEL>
+inline void SampleNearestBatch(const ImageMipsT<TEXEL>& texture, const int* mipIndices, const float* u, const float* v, TEXEL* out, size_t count)
+{
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleNearest<AddressMode::Wrap, decltype(pow2)::value>(texture[ClampMipIndex(mipIndices[index], texture.size())], Vector2{ u[index], v[index] });
+    });
+}
+
+template <typename TEXEL>
+inline void SampleBilinearBatch(const ImageMipsT<TEXEL>& texture, int mipIndex, const float* u, const float* v, typename TexelTraits<TEXEL>::Filtered* out, size_t count)
+{
+    const ImageT<TEXEL>& image = texture[ClampMipIndex(mipIndex, texture.size())];
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleBilinear<AddressMode::Wrap, decltype(pow2)::value>(image, Vector2{ u[index], v[index] });
+    });
+}
+
+template <typename TEXEL>
+inline void SampleBilinearBatch(const ImageMipsT<TEXEL>& texture, const int* mipIndices, const float* u, const float* v, typename TexelTraits<TEXEL>::Filtered* out, size_t count)
+{
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleBilinear<AddressMode::Wrap, decltype(pow2)::value>(texture[ClampMipIndex(mipIndices[index], texture.size())], Vector2{ u[index], v[index] });
+    });
+}
+
+template <typename TEXEL>
+inline void SampleTrilinearBatch(const ImageMipsT<TEXEL>& texture, float mip, const float* u, const float* v, typename TexelTraits<TEXEL>::Filtered* out, size_t count)
+{
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleTrilinear<AddressMode::Wrap, decltype(pow2)::value>(texture, Vector2{ u[index], v[index] }, mip);
+    });
+}
+
+template <typename TEXEL>
+inline void SampleTrilinearBatch(const ImageMipsT<TEXEL>& texture, const float* mips, const float* u, const float* v, typename TexelTraits<TEXEL>::Filtered* out, size_t count)
+{
+    DispatchPowerOfTwo(texture, [&](auto pow2)
+    {
+        for (size_t index = 0; index < count; ++index)
+            out[index] = SampleTrilinear<AddressMode::Wrap, decltype(pow2)::value>(texture, Vector2{ u[index], v[index] }, ClampMip(mips[index], texture.size()));
+    });
+}
+
+// The RGBU8 versions. These do 8 samples at a time with AVX2 and leave the rest to the loops above.
+
+// Whether the CPU can do the AVX2 path for a texel format, on top of having AVX2. RGBF16 needs F16C.
+template <typename TEXEL>
+inline bool BatchTexelFormatSupported()
+{
+    return true;
+}
+
+template <>
+inline bool BatchTexelFormatSupported<RGBF16>()
+{
+    return HasF16C();
+}
+
+// Sets up the tables if the AVX2 path can be used for this batch. The gathers don't report their reads, so
+// when texel reads are being recorded, the single sample versions are used instead.
+template <typename TEXEL>
+inline bool UseBatchAVX2(const ImageMipsT<TEXEL>& texture, size_t count, BatchMipTables& tables)
+{
+    return count >= 8 && GetSIMDLevel() >= SIMDLevel::AVX2 && BatchTexelFormatSupported<TEXEL>() && CurrentTexelReadHook().callback == nullptr && tables.Setup(texture);
+}
+
+inline void SampleNearestBatch(const ImageMips& texture, int mipIndex, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        for (; index + 8 <= count; index += 8)
+            StoreTexels8(&out[index], SampleNearest8(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+    }
+    SampleNearestBatch<RGBU8>(texture, mipIndex, &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleNearestBatch(const ImageMips& texture, const int* mipIndices, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            BatchLevels8 levels = GatherLevels8(tables, _mm256_loadu_si256((const __m256i*)&mipIndices[index]));
+            StoreTexels8(&out[index], SampleNearest8(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+        }
+    }
+    SampleNearestBatch<RGBU8>(texture, &mipIndices[index], &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleBilinearBatch(const ImageMips& texture, int mipIndex, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        for (; index + 8 <= count; index += 8)
+            StoreTexels8(&out[index], SampleBilinear8(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+    }
+    SampleBilinearBatch<RGBU8>(texture, mipIndex, &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleBilinearBatch(const ImageMips& texture, const int* mipIndices, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            BatchLevels8 levels = GatherLevels8(tables, _mm256_loadu_si256((const __m256i*)&mipIndices[index]));
+            StoreTexels8(&out[index], SampleBilinear8(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+        }
+    }
+    SampleBilinearBatch<RGBU8>(texture, &mipIndices[index], &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleTrilinearBatch(const ImageMips& texture, float mip, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+            StoreTexels8(&out[index], SampleTrilinear8(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), _mm256_set1_ps(mip)));
+    }
+    SampleTrilinearBatch<RGBU8>(texture, mip, &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleTrilinearBatch(const ImageMips& texture, const float* mips, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        const __m256 lastMip = _mm256_set1_ps(float(tables.lastMip));
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 mip = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&mips[index]), _mm256_setzero_ps()), lastMip);
+            StoreTexels8(&out[index], SampleTrilinear8(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), mip));
+        }
+    }
+    SampleTrilinearBatch<RGBU8>(texture, &mips[index], &u[index], &v[index], &out[index], count - index);
+}
+
+// The RGBF32 and RGBF16 versions of bilinear and trilinear sampling, which do 8 samples at a time with AVX2.
+// Nearest sampling of these formats is a copy of the texel, and stays with the loops above.
+
+template <typename TEXEL>
+inline void SampleBilinearBatchLinear(const ImageMipsT<TEXEL>& texture, int mipIndex, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        for (; index + 8 <= count; index += 8)
+            StoreLinearTexels8(&out[index], SampleBilinearLinear8<TEXEL>(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+    }
+    SampleBilinearBatch<TEXEL>(texture, mipIndex, &u[index], &v[index], &out[index], count - index);
+}
+
+template <typename TEXEL>
+inline void SampleBilinearBatchLinear(const ImageMipsT<TEXEL>& texture, const int* mipIndices, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            BatchLevels8 levels = GatherLevels8(tables, _mm256_loadu_si256((const __m256i*)&mipIndices[index]));
+            StoreLinearTexels8(&out[index], SampleBilinearLinear8<TEXEL>(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index])));
+        }
+    }
+    SampleBilinearBatch<TEXEL>(texture, &mipIndices[index], &u[index], &v[index], &out[index], count - index);
+}
+
+template <typename TEXEL>
+inline void SampleTrilinearBatchLinear(const ImageMipsT<TEXEL>& texture, float mip, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+            StoreLinearTexels8(&out[index], SampleTrilinearLinear8<TEXEL>(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), _mm256_set1_ps(mip)));
+    }
+    SampleTrilinearBatch<TEXEL>(texture, mip, &u[index], &v[index], &out[index], count - index);
+}
+
+template <typename TEXEL>
+inline void SampleTrilinearBatchLinear(const ImageMipsT<TEXEL>& texture, const float* mips, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        const __m256 lastMip = _mm256_set1_ps(float(tables.lastMip));
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 mip = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&mips[index]), _mm256_setzero_ps()), lastMip);
+            StoreLinearTexels8(&out[index], SampleTrilinearLinear8<TEXEL>(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), mip));
+        }
+    }
+    SampleTrilinearBatch<TEXEL>(texture, &mips[index], &u[index], &v[index], &out[index], count - index);
+}
+
+inline void SampleBilinearBatch(const ImageMipsT<RGBF32>& texture, int mipIndex, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleBilinearBatchLinear(texture, mipIndex, u, v, out, count);
+}
+
+inline void SampleBilinearBatch(const ImageMipsT<RGBF16>& texture, int mipIndex, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleBilinearBatchLinear(texture, mipIndex, u, v, out, count);
+}
+
+inline void SampleBilinearBatch(const ImageMipsT<RGBF32>& texture, const int* mipIndices, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleBilinearBatchLinear(texture, mipIndices, u, v, out, count);
+}
+
+inline void SampleBilinearBatch(const ImageMipsT<RGBF16>& texture, const int* mipIndices, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleBilinearBatchLinear(texture, mipIndices, u, v, out, count);
+}
+
+inline void SampleTrilinearBatch(const ImageMipsT<RGBF32>& texture, float mip, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleTrilinearBatchLinear(texture, mip, u, v, out, count);
+}
+
+inline void SampleTrilinearBatch(const ImageMipsT<RGBF16>& texture, float mip, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleTrilinearBatchLinear(texture, mip, u, v, out, count);
+}
+
+inline void SampleTrilinearBatch(const ImageMipsT<RGBF32>& texture, const float* mips, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleTrilinearBatchLinear(texture, mips, u, v, out, count);
+}
+
+inline void SampleTrilinearBatch(const ImageMipsT<RGBF16>& texture, const float* mips, const float* u, const float* v, RGBF32* out, size_t count)
+{
+    SampleTrilinearBatchLinear(texture, mips, u, v, out, count);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <intrin.h>
+
+// The instruction sets that the SIMD code paths are written for, in increasing order.
+enum class SIMDLevel
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+inline SIMDLevel DetectSIMDLevel()
+{
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // AVX2 also needs the OS to save the YMM registers on a context switch
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    if (avx2)
+        return SIMDLevel::AVX2;
+    if (sse41)
+        return SIMDLevel::SSE41;
+    return SIMDLevel::Scalar;
+}
+
+// detected once, the first time it's asked for
+inline SIMDLevel GetSIMDLevel()
+{
+    static const SIMDLevel s_level = DetectSIMDLevel();
+    return s_level;
+}
+
+// F16C converts 8 halves to floats at once. Every CPU with AVX2 so far has it, but it has a CPUID bit of its
+// own, so it gets checked on its own.
+inline bool DetectF16C()
+{
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    return osxsave && f16c && (_xgetbv(0) & 6) == 6;
+}
+
+inline bool HasF16C()
+{
+    static const bool s_f16c = DetectF16C();
+    return s_f16c;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "CPUFeatures.h"
+#include "Math.h"
+
+#include <cmath>
+#include <string.h>
+#include <immintrin.h>
+
+#include <stdint.h>
+typedef uint8_t uint8;
+typedef uint32_t uint32;
+
+enum class ColorCurve
+{
+    Gamma22,    // the simple pow(x, 2.2) approximation of sRGB
+    sRGB        // the exact piecewise sRGB curve (linear toe + 2.4 power)
+};
+
+//-------------------------------------------------------------------------------------------------------
+// Reference conversions. These call powf for every channel and are too slow to use per texel, so they are
+// only used to build the lookup tables below.
+
+// using a gamma of 2.2
+inline float sRGBU8_To_LinearFloat(uint8 in)
+{
+    float ret = float(in) / 255.0f;
+    return std::powf(ret, 2.2f);
+}
+
+inline uint8 LinearFloat_To_sRGBU8(float in)
+{
+    in = std::powf(in, 1.0f / 2.2f);
+    return uint8(clamp(in * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+// using the piecewise sRGB curve
+inline float PiecewisesRGBU8_To_LinearFloat(uint8 in)
+{
+    float ret = float(in) / 255.0f;
+    if (ret <= 0.04045f)
+        return ret / 12.92f;
+    return std::powf((ret + 0.055f) / 1.055f, 2.4f);
+}
+
+inline uint8 LinearFloat_To_PiecewisesRGBU8(float in)
+{
+    if (in <= 0.0031308f)
+        in = in * 12.92f;
+    else
+        in = 1.055f * std::powf(in, 1.0f / 2.4f) - 0.055f;
+    return uint8(clamp(in * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+inline float ReferenceDecode(ColorCurve curve, uint8 in)
+{
+    return curve == ColorCurve::sRGB ? PiecewisesRGBU8_To_LinearFloat(in) : sRGBU8_To_LinearFloat(in);
+}
+
+inline uint8 ReferenceEncode(ColorCurve curve, float in)
+{
+    return curve == ColorCurve::sRGB ? LinearFloat_To_PiecewisesRGBU8(in) : LinearFloat_To_sRGBU8(in);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Lookup tables.
+//
+// Decoding is a plain 256 entry table.
+//
+// Encoding indexes a table with the exponent and top 7 mantissa bits of the linear float, which gives the
+// encoded value at the start of that bucket. The buckets are narrow enough that the encoded value changes
+// at most once inside of one, so a single compare against the linear value where the encoded value steps
+// up makes the result match the reference conversion exactly.
+
+// linear values below 2^-21 encode to 0 for both curves
+static const float c_encodeMin = 1.0f / float(1 << 21);
+static const uint32 c_encodeBucketBase = (127 - 21) << 7;
+static const uint32 c_encodeBucketCount = 21 << 7;
+
+struct ColorTables
+{
+    ColorTables(ColorCurve curve_)
+        : curve(curve_)
+    {
+        for (int i = 0; i < 256; ++i)
+            decode[i] = ReferenceDecode(curve, uint8(i));
+
+        // find the smallest linear value that encodes to i+1 by binary searching over the float bit patterns,
+        // which are ordered the same as the floats themselves for positive values.
+        uint32 oneBits = FloatBits(1.0f);
+        for (int i = 0; i < 255; ++i)
+        {
+            uint32 low = 0;
+            uint32 high = oneBits;
+            while (low < high)
+            {
+                uint32 mid = low + (high - low) / 2;
+                if (ReferenceEncode(curve, BitsFloat(mid)) > i)
+                    high = mid;
+                else
+                    low = mid + 1;
+            }
+            encodeThresholds[i] = BitsFloat(low);
+        }
+        encodeThresholds[255] = 2.0f;
+
+        for (uint32 i = 0; i < c_encodeBucketCount; ++i)
+            encodeBuckets[i] = ReferenceEncode(curve, BitsFloat((c_encodeBucketBase + i) << 16));
+    }
+
+    static uint32 FloatBits(float f)
+    {
+        uint32 ret;
+        memcpy(&ret, &f, sizeof(ret));
+        return ret;
+    }
+
+    static float BitsFloat(uint32 bits)
+    {
+        float ret;
+        memcpy(&ret, &bits, sizeof(ret));
+        return ret;
+    }
+
+    ColorCurve curve;
+    float decode[256];
+    float encodeThresholds[256];
+    // padded so that SIMD gathers, which read 4 bytes at a time, stay in bounds
+    uint8 encodeBuckets[c_encodeBucketCount + 3] = {};
+};
+
+// The tables are built the first time they are asked for. Hot loops should get the tables once up front
+// rather than calling this per texel.
+inline const ColorTables& GetColorTables(ColorCurve curve = ColorCurve::Gamma22)
+{
+    static const ColorTables s_gamma22(ColorCurve::Gamma22);
+    static const ColorTables s_sRGB(ColorCurve::sRGB);
+    return curve == ColorCurve::sRGB ? s_sRGB : s_gamma22;
+}
+
+inline float DecodeToLinear(const ColorTables& tables, uint8 in)
+{
+    return tables.decode[in];
+}
+
+inline uint8 EncodeFromLinear(const ColorTables& tables, float in)
+{
+    // the negated compare also sends NaN to 0
+    if (!(in >= c_encodeMin))
+        return 0;
+    if (in >= 1.0f)
+        return 255;
+
+    uint8 ret = tables.encodeBuckets[(ColorTables::FloatBits(in) >> 16) - c_encodeBucketBase];
+    return ret + (in >= tables.encodeThresholds[ret] ? 1 : 0);
+}
+
+// Encodes 4 linear values at once, returning the encoded values in the low byte of each 32 bit lane.
+// SSE2 has no gather, so the two table reads are done per lane, but the range handling, bucket indexing
+// and threshold compare are all done in SIMD.
+inline __m128i EncodeFromLinear4(const ColorTables& tables, __m128 in)
+{
+    const __m128 minValue = _mm_set1_ps(c_encodeMin);
+    const __m128 maxValue = _mm_set1_ps(ColorTables::BitsFloat(ColorTables::FloatBits(1.0f) - 1));
+
+    // lanes below the table range (or NaN) become 0. Lanes at or above 1 get clamped to the largest float
+    // below 1, which already encodes to 255.
+    __m128 belowMin = _mm_cmpnge_ps(in, minValue);
+    __m128 clamped = _mm_min_ps(_mm_max_ps(in, minValue), maxValue);
+
+    __m128i bucketIndex = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(clamped), 16), _mm_set1_epi32(c_encodeBucketBase));
+
+    alignas(16) int indices[4];
+    alignas(16) int encoded[4];
+    alignas(16) float thresholds[4];
+    _mm_store_si128((__m128i*)indices, bucketIndex);
+    for (int i = 0; i < 4; ++i)
+    {
+        encoded[i] = tables.encodeBuckets[indices[i]];
+        thresholds[i] = tables.encodeThresholds[encoded[i]];
+    }
+
+    // the compare mask is -1 where the threshold was crossed, so subtracting it adds one
+    __m128i ret = _mm_load_si128((const __m128i*)encoded);
+    ret = _mm_sub_epi32(ret, _mm_castps_si128(_mm_cmpge_ps(clamped, _mm_load_ps(thresholds))));
+    return _mm_andnot_si128(_mm_castps_si128(belowMin), ret);
+}
+
+// AVX2 version of the above, with the table reads done as gathers
+inline __m256i EncodeFromLinear8(const ColorTables& tables, __m256 in)
+{
+    const __m256 minValue = _mm256_set1_ps(c_encodeMin);
+    const __m256 maxValue = _mm256_set1_ps(ColorTables::BitsFloat(ColorTables::FloatBits(1.0f) - 1));
+
+    __m256 belowMin = _mm256_cmp_ps(in, minValue, _CMP_NGE_UQ);
+    __m256 clamped = _mm256_min_ps(_mm256_max_ps(in, minValue), maxValue);
+
+    __m256i bucketIndex = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(clamped), 16), _mm256_set1_epi32(c_encodeBucketBase));
+    __m256i ret = _mm256_and_si256(_mm256_i32gather_epi32((const int*)tables.encodeBuckets, bucketIndex, 1), _mm256_set1_epi32(0xFF));
+    __m256 thresholds = _mm256_i32gather_ps(tables.encodeThresholds, ret, 4);
+
+    ret = _mm256_sub_epi32(ret, _mm256_castps_si256(_mm256_cmp_ps(clamped, thresholds, _CMP_GE_OQ)));
+    return _mm256_andnot_si256(_mm256_castps_si256(belowMin), ret);
+}
+
+// Encodes a run of linear floats to U8, 8 at a time with AVX2 or 4 at a time without it, and a scalar tail.
+// Since RGBF32 and RGBU8 are both tightly packed, this can encode whole rows of pixels in one call.
+inline void EncodeFromLinear(const ColorTables& tables, const float* in, uint8* out, size_t count)
+{
+    size_t index = 0;
+    if (GetSIMDLevel() >= SIMDLevel::AVX2)
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256i encoded = EncodeFromLinear8(tables, _mm256_loadu_ps(&in[index]));
+            encoded = _mm256_packus_epi16(_mm256_packs_epi32(encoded, encoded), encoded);
+            int packedLow = _mm_cvtsi128_si32(_mm256_castsi256_si128(encoded));
+            int packedHigh = _mm_cvtsi128_si32(_mm256_extracti128_si256(encoded, 1));
+            memcpy(&out[index], &packedLow, 4);
+            memcpy(&out[index + 4], &packedHigh, 4);
+        }
+    }
+
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128i encoded = EncodeFromLinear4(tables, _mm_loadu_ps(&in[index]));
+        encoded = _mm_packus_epi16(_mm_packs_epi32(encoded, encoded), encoded);
+        int packed = _mm_cvtsi128_si32(encoded);
+        memcpy(&out[index], &packed, 4);
+    }
+
+    for (; index < count; ++index)
+        out[index] = EncodeFromLinear(tables, in[index]);
+}
+
+// Decodes a run of U8 to linear floats, 8 at a time with AVX2 gathers from the table
+inline void DecodeToLinear(const ColorTables& tables, const uint8* in, float* out, size_t count)
+{
+    size_t index = 0;
+    if (GetSIMDLevel() >= SIMDLevel::AVX2)
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&in[index]));
+            _mm256_storeu_ps(&out[index], _mm256_i32gather_ps(tables.decode, indices, 4));
+        }
+    }
+
+    for (; index < count; ++index)
+        out[index] = tables.decode[in[index]];
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "AnisotropicSampling.h"
+
+#include <cmath>
+
+// Elliptical weighted average (EWA) filtering, for reference quality results under any affine mapping,
+// including rotations where the footprint of a pixel isn't lined up with the texture axes.
+//
+// The footprint of a pixel on the texture is an ellipse, with the uv derivatives on x and y as its conjugate
+// axes. Every texel inside of the ellipse is weighted by a gaussian of its distance from the center, as
+// measured in the ellipse's own coordinates. The ellipse is grown by a texel on each axis first, so that it
+// always covers some texels when magnifying.
+//
+// The mip is picked so the minor radius of the ellipse is about two texels, and the major axis is limited to
+// maxAnisotropy times the minor axis by growing the minor axis when it's more eccentric than that. The radii
+// are the principal ones, from the eigenvalues of the ellipse, since the derivatives needn't be. That bounds
+// the number of texels read to about 4 pi maxAnisotropy, however big the footprint is. Picking the mip with a
+// minor radius of one texel instead reads a quarter as many texels, but is noticeably blurrier. Like
+// trilinear sampling, the two mips around the fractional mip are both filtered, and blended.
+//
+// The gaussian weights come from a table indexed by the squared distance, instead of calling exp() per texel.
+
+static const int c_ewaWeightTableSize = 128;
+static const float c_ewaGaussianAlpha = 2.0f;
+static const float c_ewaMaxAnisotropy = 8.0f;
+
+struct EWAWeightTable
+{
+    float weights[c_ewaWeightTableSize];
+};
+
+// exp(-alpha * r^2) at squared distances r^2 in [0, 1), shifted down so that it reaches 0 at the edge of the
+// ellipse instead of stopping suddenly
+inline const EWAWeightTable& GetEWAWeightTable()
+{
+    static const EWAWeightTable s_table = []()
+    {
+        EWAWeightTable table;
+        for (int index = 0; index < c_ewaWeightTableSize; ++index)
+        {
+            float distanceSquared = float(index) / float(c_ewaWeightTableSize - 1);
+            table.weights[index] = std::expf(-c_ewaGaussianAlpha * distanceSquared) - std::expf(-c_ewaGaussianAlpha);
+        }
+        return table;
+    }();
+    return s_table;
+}
+
+// Filters one mip with the ellipse. The derivatives are in uvs, and get scaled to texels of the mip here.
+template <AddressMode MODE, bool POW2, typename TEXEL>
+inline RGBF32 SampleEWAMip(const ImageT<TEXEL>& image, const Vector2& uv, const Vector2& d_uv_dx, const Vector2& d_uv_dy)
+{
+    const EWAWeightTable& weightTable = GetEWAWeightTable();
+
+    // the center, with texel centers at whole numbers, the same way bilinear sampling places them
+    float centerX = (uv[0] + AddressUVOffset<MODE>()) * float(image.width) - 0.5f;
+    float centerY = (uv[1] + AddressUVOffset<MODE>()) * float(image.height) - 0.5f;
+    float dx0 = d_uv_dx[0] * float(image.width);
+    float dy0 = d_uv_dx[1] * float(image.height);
+    float dx1 = d_uv_dy[0] * float(image.width);
+    float dy1 = d_uv_dy[1] * float(image.height);
+
+    // the implicit ellipse A x^2 + B x y + C y^2 < 1, with a texel added to each axis
+    float A = dy0 * dy0 + dy1 * dy1 + 1.0f;
+    float B = -2.0f * (dx0 * dy0 + dx1 * dy1);
+    float C = dx0 * dx0 + dx1 * dx1 + 1.0f;
+    float invF = 1.0f / (A * C - B * B * 0.25f);
+    A *= invF;
+    B *= invF;
+    C *= invF;
+
+    // the bounding box of the ellipse
+    float det = 4.0f * A * C - B * B;
+    float halfWidth = 2.0f * std::sqrtf(det * C) / det;
+    float halfHeight = 2.0f * std::sqrtf(det * A) / det;
+    int x0 = int(std::ceilf(centerX - halfWidth));
+    int x1 = int(std::floorf(centerX + halfWidth));
+    int y0 = int(std::ceilf(centerY - halfHeight));
+    int y1 = int(std::floorf(centerY + halfHeight));
+
+    RGBF32 sum;
+    float weightSum = 0.0f;
+    for (int y = y0; y <= y1; ++y)
+    {
+        float offsetY = float(y) - centerY;
+        int texelY = TexelAddress<MODE, POW2>::Address(y, image.height);
+        for (int x = x0; x <= x1; ++x)
+        {
+            float offsetX = float(x) - centerX;
+            float distanceSquared = A * offsetX * offsetX + B * offsetX * offsetY + C * offsetY * offsetY;
+            if (distanceSquared >= 1.0f)
+                continue;
+
+            float weight = weightTable.weights[int(distanceSquared * float(c_ewaWeightTableSize - 1) + 0.5f)];
+            int texelX = TexelAddress<MODE, POW2>::Address(x, image.width);
+            sum += AnisotropicTapToSum(FetchTexel<MODE>(image, texelX, texelY)) * weight;
+            weightSum += weight;
+        }
+    }
+
+    // the last entry of the table is 0, so a texel right on the edge of a tiny ellipse could be all there is
+    if (weightSum > 0.0f)
+        sum *= 1.0f / weightSum;
+    return sum;
+}
+
+// Samples with the ellipse given by the derivatives, which are how the uv changes from one pixel to the next
+// on x and on y.
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline typename TexelTraits<TEXEL>::Filtered SampleEWA(const ImageMipsT<TEXEL>& texture, const Vector2& uv, const Vector2& d_uv_dx, const Vector2& d_uv_dy, float maxAnisotropy = c_ewaMaxAnisotropy)
+{
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    // The implicit ellipse A x^2 + B x y + C y^2 = F, in texels of mip 0, the same as SampleEWAMip() makes but
+    // without the added texel. The derivatives are only conjugate axes, so the principal axes come from the
+    // eigenvalues of the conic. The major axis is along the eigenvector of the smaller one, and the radius
+    // along an eigenvector is sqrt(F / eigenvalue). F is the product of the eigenvalues, so each radius is
+    // the square root of the other eigenvalue.
+    float dx0 = d_uv_dx[0] * float(texture[0].width);
+    float dy0 = d_uv_dx[1] * float(texture[0].height);
+    float dx1 = d_uv_dy[0] * float(texture[0].width);
+    float dy1 = d_uv_dy[1] * float(texture[0].height);
+    float A = dy0 * dy0 + dy1 * dy1;
+    float halfB = -(dx0 * dy0 + dx1 * dy1);
+    float C = dx0 * dx0 + dx1 * dx1;
+    float root = std::sqrtf((A - C) * (A - C) * 0.25f + halfB * halfB);
+    float eigenvalueLarge = (A + C) * 0.5f + root;
+    float eigenvalueSmall = std::max((A + C) * 0.5f - root, 0.0f);
+    float majorLength = std::sqrtf(eigenvalueLarge);
+    float minorLength = std::sqrtf(eigenvalueSmall);
+
+    // the eigenvector of the smaller eigenvalue, from whichever row of the conic gives the longer one. A circle
+    // has no preferred direction.
+    Vector2 majorAxis = { halfB, eigenvalueSmall - A };
+    Vector2 otherRow = { eigenvalueSmall - C, halfB };
+    if (Dot(otherRow, otherRow) > Dot(majorAxis, majorAxis))
+        majorAxis = otherRow;
+    float majorAxisLength = std::sqrtf(Dot(majorAxis, majorAxis));
+    if (majorAxisLength > 0.0f)
+        majorAxis = Vector2{ majorAxis[0] / majorAxisLength, majorAxis[1] / majorAxisLength };
+    else
+        majorAxis = Vector2{ 1.0f, 0.0f };
+
+    // limit the eccentricity by growing the minor axis, so the number of texels stays bounded
+    minorLength = std::max(minorLength, majorLength / maxAnisotropy);
+
+    // back to uvs, for SampleEWAMip() to scale to each mip
+    Vector2 uvMajor = { majorAxis[0] * majorLength / float(texture[0].width), majorAxis[1] * majorLength / float(texture[0].height) };
+    Vector2 uvMinor = { -majorAxis[1] * minorLength / float(texture[0].width), majorAxis[0] * minorLength / float(texture[0].height) };
+
+    float mip = clamp(std::log2f(std::max(minorLength, 1e-6f)) - 1.0f, 0.0f, float(texture.size() - 1));
+    int mipInt = std::min(int(mip), int(texture.size()) - 1);
+    float mipFract = mip - float(mipInt);
+
+    RGBF32 sum = SampleEWAMip<MODE, POW2>(texture[mipInt], uv, uvMajor, uvMinor);
+    if (mipFract > 0.0f && mipInt + 1 < int(texture.size()))
+        sum = lerp(sum, SampleEWAMip<MODE, POW2>(texture[mipInt + 1], uv, uvMajor, uvMinor), mipFract);
+
+    Filtered ret;
+    AnisotropicSumToTap(sum, ret);
+    return ret;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "BatchSampling.h"
+
+// Bilinear and trilinear sampling of RGBU8 textures done entirely in integers.
+//
+// The float samplers lerp RGBU8 values with float weights and truncate after every lerp. These instead
+// quantize the weights to 8 bits (0 to 256, where 256 is 1.0), and keep colors as 8.7 fixed point between
+// lerps. Every lerp rounds to nearest, so the results are deterministic and rounded correctly, and can be
+// slightly different from the float samplers.
+//
+// A color in 8.7 fixed point and a weight both fit in signed 16 bit lanes, and a color times a weight,
+// summed over two taps, fits in 32 bits. That lets the AVX2 path do each lerp of 8 samples with pmaddwd.
+// pmaddubsw can't be used because a weight of 1.0 doesn't fit in a signed byte.
+
+static const int c_fixedColorBits = 7;
+static const int c_fixedWeightBits = 8;
+static const int c_fixedWeightOne = 1 << c_fixedWeightBits;
+
+// quantizes a weight in [0, 1] to [0, c_fixedWeightOne]
+inline int FixedWeight(float weight)
+{
+    return int(weight * float(c_fixedWeightOne) + 0.5f);
+}
+
+// lerps two 8.7 fixed point values, rounding to nearest
+inline int LerpFixed(int a, int b, int weight)
+{
+    return (a * (c_fixedWeightOne - weight) + b * weight + (c_fixedWeightOne / 2)) >> c_fixedWeightBits;
+}
+
+// an RGB color in 8.7 fixed point
+struct RGBFixed
+{
+    int r = 0;
+    int g = 0;
+    int b = 0;
+};
+
+inline RGBFixed ToFixed(const RGBU8& color)
+{
+    return RGBFixed{ color.r << c_fixedColorBits, color.g << c_fixedColorBits, color.b << c_fixedColorBits };
+}
+
+inline RGBU8 FromFixed(const RGBFixed& color)
+{
+    const int c_half = 1 << (c_fixedColorBits - 1);
+    return RGBU8{ uint8((color.r + c_half) >> c_fixedColorBits), uint8((color.g + c_half) >> c_fixedColorBits), uint8((color.b + c_half) >> c_fixedColorBits) };
+}
+
+inline RGBFixed LerpFixed(const RGBFixed& a, const RGBFixed& b, int weight)
+{
+    return RGBFixed{ LerpFixed(a.r, b.r, weight), LerpFixed(a.g, b.g, weight), LerpFixed(a.b, b.b, weight) };
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Scalar versions. These define the results, which the AVX2 path matches exactly.
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false>
+inline RGBFixed SampleBilinearFixedPoint(const Image& image, const Vector2& uv)
+{
+    int x0, x1, y0, y1;
+    float xweight, yweight;
+    BilinearTexels<MODE, POW2>(uv[0], image.width, x0, x1, xweight);
+    BilinearTexels<MODE, POW2>(uv[1], image.height, y0, y1, yweight);
+
+    RGBFixed p00 = ToFixed(FetchTexel<MODE>(image, x0, y0));
+    RGBFixed p10 = ToFixed(FetchTexel<MODE>(image, x1, y0));
+    RGBFixed p01 = ToFixed(FetchTexel<MODE>(image, x0, y1));
+    RGBFixed p11 = ToFixed(FetchTexel<MODE>(image, x1, y1));
+
+    int xweightFixed = FixedWeight(xweight);
+    RGBFixed px0 = LerpFixed(p00, p10, xweightFixed);
+    RGBFixed px1 = LerpFixed(p01, p11, xweightFixed);
+
+    return LerpFixed(px0, px1, FixedWeight(yweight));
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false>
+inline RGBU8 SampleBilinearFixed(const Image& image, const Vector2& uv)
+{
+    return FromFixed(SampleBilinearFixedPoint<MODE, POW2>(image, uv));
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false>
+inline RGBU8 SampleTrilinearFixed(const ImageMips& texture, const Vector2& uv, float mip)
+{
+    RGBFixed bilinearLowMip = SampleBilinearFixedPoint<MODE, POW2>(texture[std::min(int(mip), (int)texture.size() - 1)], uv);
+    RGBFixed bilinearHighMip = SampleBilinearFixedPoint<MODE, POW2>(texture[std::min(int(mip) + 1, (int)texture.size() - 1)], uv);
+    return FromFixed(LerpFixed(bilinearLowMip, bilinearHighMip, FixedWeight(std::fmodf(mip, 1.0f))));
+}
+
+//-------------------------------------------------------------------------------------------------------
+// AVX2 internals
+//
+// 8 samples of 8.7 colors are held in two registers of 16 bit lanes, 4 lanes (RGB and an unused lane) per
+// sample. Unpacking the gathered texels within 128 bit halves puts samples 0, 1, 4 and 5 in the low
+// register and 2, 3, 6 and 7 in the high one.
+
+struct Fixed8
+{
+    __m256i low;
+    __m256i high;
+};
+
+inline Fixed8 TexelsToFixed8(__m256i texels)
+{
+    Fixed8 ret;
+    ret.low = _mm256_slli_epi16(_mm256_unpacklo_epi8(texels, _mm256_setzero_si256()), c_fixedColorBits);
+    ret.high = _mm256_slli_epi16(_mm256_unpackhi_epi8(texels, _mm256_setzero_si256()), c_fixedColorBits);
+    return ret;
+}
+
+inline __m256i FixedToTexels8(const Fixed8& color)
+{
+    const __m256i half = _mm256_set1_epi16(1 << (c_fixedColorBits - 1));
+    __m256i low = _mm256_srli_epi16(_mm256_add_epi16(color.low, half), c_fixedColorBits);
+    __m256i high = _mm256_srli_epi16(_mm256_add_epi16(color.high, half), c_fixedColorBits);
+    return _mm256_packus_epi16(low, high);
+}
+
+// quantizes the weights of 8 samples and packs each into a 32 bit lane as (1 - weight, weight)
+inline __m256i FixedWeights8(__m256 weight)
+{
+    __m256i weightFixed = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(weight, _mm256_set1_ps(float(c_fixedWeightOne))), _mm256_set1_ps(0.5f)));
+    return _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(c_fixedWeightOne), weightFixed), _mm256_slli_epi32(weightFixed, 16));
+}
+
+// Lerps the 2 samples in each 128 bit half of a register. The weights are broadcast with the shuffles
+// given, which pick out the samples from the 8 packed weights.
+template <int SHUFFLE_A, int SHUFFLE_B>
+inline __m256i LerpFixedHalf8(__m256i a, __m256i b, __m256i weights)
+{
+    const __m256i half = _mm256_set1_epi32(c_fixedWeightOne / 2);
+    __m256i sampleA = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), _mm256_shuffle_epi32(weights, SHUFFLE_A));
+    __m256i sampleB = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), _mm256_shuffle_epi32(weights, SHUFFLE_B));
+    sampleA = _mm256_srai_epi32(_mm256_add_epi32(sampleA, half), c_fixedWeightBits);
+    sampleB = _mm256_srai_epi32(_mm256_add_epi32(sampleB, half), c_fixedWeightBits);
+    return _mm256_packs_epi32(sampleA, sampleB);
+}
+
+inline Fixed8 LerpFixed8(const Fixed8& a, const Fixed8& b, __m256i weights)
+{
+    Fixed8 ret;
+    ret.low = LerpFixedHalf8<0x00, 0x55>(a.low, b.low, weights);
+    ret.high = LerpFixedHalf8<0xAA, 0xFF>(a.high, b.high, weights);
+    return ret;
+}
+
+inline Fixed8 SampleBilinearFixed8(const BatchMipTables& tables, const BatchLevels8& levels, __m256 u, __m256 v)
+{
+    __m256i x0, x1, y0, y1;
+    __m256 xweight, yweight;
+    BilinearCoordinates8(u, levels.width, x0, x1, xweight);
+    BilinearCoordinates8(v, levels.height, y0, y1, yweight);
+
+    Fixed8 p00 = TexelsToFixed8(FetchTexels8(tables, levels, x0, y0));
+    Fixed8 p10 = TexelsToFixed8(FetchTexels8(tables, levels, x1, y0));
+    Fixed8 p01 = TexelsToFixed8(FetchTexels8(tables, levels, x0, y1));
+    Fixed8 p11 = TexelsToFixed8(FetchTexels8(tables, levels, x1, y1));
+
+    __m256i xweights = FixedWeights8(xweight);
+    Fixed8 px0 = LerpFixed8(p00, p10, xweights);
+    Fixed8 px1 = LerpFixed8(p01, p11, xweights);
+    return LerpFixed8(px0, px1, FixedWeights8(yweight));
+}
+
+inline Fixed8 SampleTrilinearFixed8(const BatchMipTables& tables, __m256 u, __m256 v, __m256 mip)
+{
+    __m256i mipInt = _mm256_cvttps_epi32(mip);
+    __m256 mipFract = _mm256_sub_ps(mip, _mm256_round_ps(mip, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+
+    Fixed8 bilinearLowMip = SampleBilinearFixed8(tables, GatherLevels8(tables, mipInt), u, v);
+    Fixed8 bilinearHighMip = SampleBilinearFixed8(tables, GatherLevels8(tables, _mm256_add_epi32(mipInt, _mm256_set1_epi32(1))), u, v);
+    return LerpFixed8(bilinearLowMip, bilinearHighMip, FixedWeights8(mipFract));
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Batch versions, with the same interface as the ones in BatchSampling.h. These always wrap.
+
+inline void SampleBilinearFixedBatch(const ImageMips& texture, int mipIndex, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        for (; index + 8 <= count; index += 8)
+            StoreTexels8(&out[index], FixedToTexels8(SampleBilinearFixed8(tables, levels, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]))));
+    }
+
+    const Image& image = texture[ClampMipIndex(mipIndex, texture.size())];
+    for (; index < count; ++index)
+        out[index] = SampleBilinearFixed(image, Vector2{ u[index], v[index] });
+}
+
+inline void SampleTrilinearFixedBatch(const ImageMips& texture, float mip, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        for (; index + 8 <= count; index += 8)
+            StoreTexels8(&out[index], FixedToTexels8(SampleTrilinearFixed8(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), _mm256_set1_ps(mip))));
+    }
+
+    for (; index < count; ++index)
+        out[index] = SampleTrilinearFixed(texture, Vector2{ u[index], v[index] }, mip);
+}
+
+inline void SampleTrilinearFixedBatch(const ImageMips& texture, const float* mips, const float* u, const float* v, RGBU8* out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        const __m256 lastMip = _mm256_set1_ps(float(tables.lastMip));
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 mip = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&mips[index]), _mm256_setzero_ps()), lastMip);
+            StoreTexels8(&out[index], FixedToTexels8(SampleTrilinearFixed8(tables, _mm256_loadu_ps(&u[index]), _mm256_loadu_ps(&v[index]), mip)));
+        }
+    }
+
+    for (; index < count; ++index)
+        out[index] = SampleTrilinearFixed(texture, Vector2{ u[index], v[index] }, ClampMip(mips[index], texture.size()));
+}
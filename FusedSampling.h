@@ -0,0 +1,315 @@
+#pragma once
+
+#include "BatchSampling.h"
+
+// A sampler that does several of the usual filters at once, for comparing them side by side like
+// TestMipMatrix does, without doing the same work for each one.
+//
+// Nearest and bilinear sampling of the same mip both start by turning the uv into texel coordinates, and
+// the texel nearest sampling picks is always one of the 4 that bilinear sampling reads. Trilinear sampling
+// then does bilinear sampling of that same mip again, plus the mip after it. So this works out the
+// addressing once per mip, reads the 4 bilinear texels once, and makes every filter asked for from them.
+// Nearest sampling of mip 0 shares the texels too when the mip is 0.
+//
+// The filters wanted are given as a bitmask. The results are the same as calling the separate samplers,
+// except that the nearest results come back as TexelTraits::Filtered, the same type as the others. (If the
+// compiler fuses the multiply and subtract of the bilinear coordinate into an FMA, the AVX2 version can pick
+// the other nearest texel for a uv right on the edge between two texels.)
+
+static const uint32 c_sampleNearestMip0 = 1 << 0;  // SampleNearest() of mip 0
+static const uint32 c_sampleNearest = 1 << 1;      // SampleNearest() of the mip
+static const uint32 c_sampleBilinear = 1 << 2;     // SampleBilinear() of the mip
+static const uint32 c_sampleTrilinear = 1 << 3;    // SampleTrilinear()
+static const uint32 c_sampleAll = c_sampleNearestMip0 | c_sampleNearest | c_sampleBilinear | c_sampleTrilinear;
+
+template <typename FILTERED>
+struct FusedSamples
+{
+    FILTERED nearestMip0;
+    FILTERED nearest;
+    FILTERED bilinear;
+    FILTERED trilinear;
+};
+
+// The bilinear texels for a uv, and which of them nearest sampling would pick on each axis
+template <typename FILTERED>
+struct FusedTexels
+{
+    FILTERED p00;
+    FILTERED p10;
+    FILTERED p01;
+    FILTERED p11;
+    float xweight = 0.0f;
+    float yweight = 0.0f;
+    bool nearestX1 = false;
+    bool nearestY1 = false;
+
+    FILTERED Nearest() const
+    {
+        return nearestY1 ? (nearestX1 ? p11 : p01) : (nearestX1 ? p10 : p00);
+    }
+
+    FILTERED Bilinear() const
+    {
+        FILTERED px0 = lerp(p00, p10, xweight);
+        FILTERED px1 = lerp(p01, p11, xweight);
+        return lerp(px0, px1, yweight);
+    }
+};
+
+// BilinearTexels(), which also says whether NearestTexel() would be coord1 instead of coord0. The texel a uv
+// falls in is either the floor of the bilinear coordinate or the one after it.
+template <AddressMode MODE, bool POW2>
+inline void FusedTexelCoordinates(float uv, int size, int& coord0, int& coord1, float& fract, bool& nearestIsCoord1)
+{
+    float x = (uv + AddressUVOffset<MODE>()) * float(size);
+    float bilinearX = (uv + AddressUVOffset<MODE>()) * float(size) - 0.5f;
+    float floorX = std::floor(bilinearX);
+    fract = bilinearX - floorX;
+    nearestIsCoord1 = std::floor(x) > floorX;
+    coord0 = TexelAddress<MODE, POW2>::Address(int(floorX), size);
+    coord1 = TexelAddress<MODE, POW2>::Address(int(floorX) + 1, size);
+}
+
+template <AddressMode MODE, bool POW2, typename TEXEL>
+inline FusedTexels<typename TexelTraits<TEXEL>::Filtered> FetchFusedTexels(const ImageT<TEXEL>& image, const Vector2& uv)
+{
+    FusedTexels<typename TexelTraits<TEXEL>::Filtered> ret;
+
+    int x0, x1, y0, y1;
+    FusedTexelCoordinates<MODE, POW2>(uv[0], image.width, x0, x1, ret.xweight, ret.nearestX1);
+    FusedTexelCoordinates<MODE, POW2>(uv[1], image.height, y0, y1, ret.yweight, ret.nearestY1);
+
+    ret.p00 = FetchTexel<MODE>(image, x0, y0);
+    ret.p10 = FetchTexel<MODE>(image, x1, y0);
+    ret.p01 = FetchTexel<MODE>(image, x0, y1);
+    ret.p11 = FetchTexel<MODE>(image, x1, y1);
+    return ret;
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline FusedSamples<typename TexelTraits<TEXEL>::Filtered> SampleFused(const ImageMipsT<TEXEL>& texture, const Vector2& uv, float mip, uint32 filters)
+{
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    FusedSamples<Filtered> ret;
+    int mipIndex = std::min(int(mip), (int)texture.size() - 1);
+
+    // nearest of mip 0 only reads a texel of its own if the other filters are on a different mip
+    bool mipTexelsNeeded = (filters & (c_sampleNearest | c_sampleBilinear | c_sampleTrilinear)) != 0;
+    FusedTexels<Filtered> texels;
+    if (mipTexelsNeeded)
+        texels = FetchFusedTexels<MODE, POW2>(texture[mipIndex], uv);
+
+    if (filters & c_sampleNearestMip0)
+    {
+        if (mipTexelsNeeded && mipIndex == 0)
+            ret.nearestMip0 = texels.Nearest();
+        else
+            ret.nearestMip0 = TexelTraits<TEXEL>::Fetch(SampleNearest<MODE, POW2>(texture[0], uv));
+    }
+
+    if (filters & c_sampleNearest)
+        ret.nearest = texels.Nearest();
+
+    if (filters & (c_sampleBilinear | c_sampleTrilinear))
+    {
+        ret.bilinear = texels.Bilinear();
+
+        if (filters & c_sampleTrilinear)
+        {
+            // past the last mip, the next mip is the same one again
+            int nextMipIndex = std::min(int(mip) + 1, (int)texture.size() - 1);
+            Filtered bilinearHighMip = (nextMipIndex == mipIndex) ? ret.bilinear : SampleBilinear<MODE, POW2>(texture[nextMipIndex], uv);
+            ret.trilinear = lerp(ret.bilinear, bilinearHighMip, std::fmodf(mip, 1.0f));
+        }
+    }
+
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Batch versions. Each output is written for the filters in the bitmask, and the others can be null.
+
+template <typename FILTERED>
+struct FusedBatchOutput
+{
+    FILTERED* nearestMip0 = nullptr;
+    FILTERED* nearest = nullptr;
+    FILTERED* bilinear = nullptr;
+    FILTERED* trilinear = nullptr;
+};
+
+template <typename TEXEL>
+inline void SampleFusedBatch(const ImageMipsT<TEXEL>& texture, float mip, uint32 filters, const float* u, const float* v, const FusedBatchOutput<typename TexelTraits<TEXEL>::Filtered>& out, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+    {
+        FusedSamples<typename TexelTraits<TEXEL>::Filtered> samples = SampleFused(texture, Vector2{ u[index], v[index] }, mip, filters);
+        if (filters & c_sampleNearestMip0)
+            out.nearestMip0[index] = samples.nearestMip0;
+        if (filters & c_sampleNearest)
+            out.nearest[index] = samples.nearest;
+        if (filters & c_sampleBilinear)
+            out.bilinear[index] = samples.bilinear;
+        if (filters & c_sampleTrilinear)
+            out.trilinear[index] = samples.trilinear;
+    }
+}
+
+// The lanes where SampleNearest8() would pick coord1 from BilinearCoordinates8(). The bilinear coordinate is
+// half a texel back from the nearest one, so nearest sampling is in the second texel when the bilinear
+// weight of it is at least half. This doesn't redo any of the addressing math, which also means the compiler
+// can't share parts of it with BilinearCoordinates8() and round differently than the separate samplers do.
+inline __m256 NearestIsCoord1_8(__m256 fract)
+{
+    return _mm256_cmp_ps(fract, _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+}
+
+// The RGBU8 version, which does 8 samples at a time with AVX2
+inline void SampleFusedBatch(const ImageMips& texture, float mip, uint32 filters, const float* u, const float* v, const FusedBatchOutput<RGBU8>& out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        int mipIndex = std::min(int(mip), (int)texture.size() - 1);
+        int nextMipIndex = std::min(int(mip) + 1, (int)texture.size() - 1);
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        BatchLevels8 nextLevels = GatherLevels8(tables, _mm256_set1_epi32(nextMipIndex));
+        BatchLevels8 levels0 = GatherLevels8(tables, _mm256_setzero_si256());
+        __m256 mipFract = _mm256_set1_ps(std::fmodf(mip, 1.0f));
+
+        bool mipTexelsNeeded = (filters & (c_sampleNearest | c_sampleBilinear | c_sampleTrilinear)) != 0;
+        bool nearestMip0Shared = mipTexelsNeeded && mipIndex == 0;
+
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 u8 = _mm256_loadu_ps(&u[index]);
+            __m256 v8 = _mm256_loadu_ps(&v[index]);
+
+            __m256i nearest = _mm256_setzero_si256();
+            __m256i bilinear = _mm256_setzero_si256();
+            if (mipTexelsNeeded)
+            {
+                __m256i x0, x1, y0, y1;
+                __m256 xweight, yweight, nearestX1, nearestY1;
+                BilinearCoordinates8(u8, levels.width, x0, x1, xweight);
+                BilinearCoordinates8(v8, levels.height, y0, y1, yweight);
+                nearestX1 = NearestIsCoord1_8(xweight);
+                nearestY1 = NearestIsCoord1_8(yweight);
+
+                __m256i p00 = FetchTexels8(tables, levels, x0, y0);
+                __m256i p10 = FetchTexels8(tables, levels, x1, y0);
+                __m256i p01 = FetchTexels8(tables, levels, x0, y1);
+                __m256i p11 = FetchTexels8(tables, levels, x1, y1);
+
+                __m256i nearestRow0 = _mm256_blendv_epi8(p00, p10, _mm256_castps_si256(nearestX1));
+                __m256i nearestRow1 = _mm256_blendv_epi8(p01, p11, _mm256_castps_si256(nearestX1));
+                nearest = _mm256_blendv_epi8(nearestRow0, nearestRow1, _mm256_castps_si256(nearestY1));
+
+                if (filters & (c_sampleBilinear | c_sampleTrilinear))
+                    bilinear = LerpTexels8(LerpTexels8(p00, p10, xweight), LerpTexels8(p01, p11, xweight), yweight);
+            }
+
+            if (filters & c_sampleNearestMip0)
+                StoreTexels8(&out.nearestMip0[index], nearestMip0Shared ? nearest : SampleNearest8(tables, levels0, u8, v8));
+            if (filters & c_sampleNearest)
+                StoreTexels8(&out.nearest[index], nearest);
+            if (filters & c_sampleBilinear)
+                StoreTexels8(&out.bilinear[index], bilinear);
+            if (filters & c_sampleTrilinear)
+            {
+                __m256i bilinearHighMip = (nextMipIndex == mipIndex) ? bilinear : SampleBilinear8(tables, nextLevels, u8, v8);
+                StoreTexels8(&out.trilinear[index], LerpTexels8(bilinear, bilinearHighMip, mipFract));
+            }
+        }
+    }
+
+    FusedBatchOutput<RGBU8> rest;
+    rest.nearestMip0 = out.nearestMip0 ? &out.nearestMip0[index] : nullptr;
+    rest.nearest = out.nearest ? &out.nearest[index] : nullptr;
+    rest.bilinear = out.bilinear ? &out.bilinear[index] : nullptr;
+    rest.trilinear = out.trilinear ? &out.trilinear[index] : nullptr;
+    SampleFusedBatch<RGBU8>(texture, mip, filters, &u[index], &v[index], rest, count - index);
+}
+
+// The RGBF32 and RGBF16 version, which does 8 samples at a time with AVX2 the same way, with the texels as
+// floats
+template <typename TEXEL>
+inline void SampleFusedBatchLinear(const ImageMipsT<TEXEL>& texture, float mip, uint32 filters, const float* u, const float* v, const FusedBatchOutput<RGBF32>& out, size_t count)
+{
+    BatchMipTables tables;
+    size_t index = 0;
+    if (UseBatchAVX2(texture, count, tables))
+    {
+        int mipIndex = std::min(int(mip), (int)texture.size() - 1);
+        int nextMipIndex = std::min(int(mip) + 1, (int)texture.size() - 1);
+        BatchLevels8 levels = GatherLevels8(tables, _mm256_set1_epi32(mipIndex));
+        BatchLevels8 nextLevels = GatherLevels8(tables, _mm256_set1_epi32(nextMipIndex));
+        BatchLevels8 levels0 = GatherLevels8(tables, _mm256_setzero_si256());
+        __m256 mipFract = _mm256_set1_ps(std::fmodf(mip, 1.0f));
+
+        bool mipTexelsNeeded = (filters & (c_sampleNearest | c_sampleBilinear | c_sampleTrilinear)) != 0;
+        bool nearestMip0Shared = mipTexelsNeeded && mipIndex == 0;
+
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 u8 = _mm256_loadu_ps(&u[index]);
+            __m256 v8 = _mm256_loadu_ps(&v[index]);
+
+            LinearTexels8 nearest = {};
+            LinearTexels8 bilinear = {};
+            if (mipTexelsNeeded)
+            {
+                __m256i x0, x1, y0, y1;
+                __m256 xweight, yweight;
+                BilinearCoordinates8(u8, levels.width, x0, x1, xweight);
+                BilinearCoordinates8(v8, levels.height, y0, y1, yweight);
+                __m256 nearestX1 = NearestIsCoord1_8(xweight);
+                __m256 nearestY1 = NearestIsCoord1_8(yweight);
+
+                LinearTexels8 p00 = FetchLinearTexels8<TEXEL>(tables, levels, x0, y0);
+                LinearTexels8 p10 = FetchLinearTexels8<TEXEL>(tables, levels, x1, y0);
+                LinearTexels8 p01 = FetchLinearTexels8<TEXEL>(tables, levels, x0, y1);
+                LinearTexels8 p11 = FetchLinearTexels8<TEXEL>(tables, levels, x1, y1);
+
+                LinearTexels8 nearestRow0 = BlendLinearTexels8(p00, p10, nearestX1);
+                LinearTexels8 nearestRow1 = BlendLinearTexels8(p01, p11, nearestX1);
+                nearest = BlendLinearTexels8(nearestRow0, nearestRow1, nearestY1);
+
+                if (filters & (c_sampleBilinear | c_sampleTrilinear))
+                    bilinear = LerpLinearTexels8(LerpLinearTexels8(p00, p10, xweight), LerpLinearTexels8(p01, p11, xweight), yweight);
+            }
+
+            if (filters & c_sampleNearestMip0)
+                StoreLinearTexels8(&out.nearestMip0[index], nearestMip0Shared ? nearest : SampleNearestLinear8<TEXEL>(tables, levels0, u8, v8));
+            if (filters & c_sampleNearest)
+                StoreLinearTexels8(&out.nearest[index], nearest);
+            if (filters & c_sampleBilinear)
+                StoreLinearTexels8(&out.bilinear[index], bilinear);
+            if (filters & c_sampleTrilinear)
+            {
+                LinearTexels8 bilinearHighMip = (nextMipIndex == mipIndex) ? bilinear : SampleBilinearLinear8<TEXEL>(tables, nextLevels, u8, v8);
+                StoreLinearTexels8(&out.trilinear[index], LerpLinearTexels8(bilinear, bilinearHighMip, mipFract));
+            }
+        }
+    }
+
+    FusedBatchOutput<RGBF32> rest;
+    rest.nearestMip0 = out.nearestMip0 ? &out.nearestMip0[index] : nullptr;
+    rest.nearest = out.nearest ? &out.nearest[index] : nullptr;
+    rest.bilinear = out.bilinear ? &out.bilinear[index] : nullptr;
+    rest.trilinear = out.trilinear ? &out.trilinear[index] : nullptr;
+    SampleFusedBatch<TEXEL>(texture, mip, filters, &u[index], &v[index], rest, count - index);
+}
+
+inline void SampleFusedBatch(const ImageMipsT<RGBF32>& texture, float mip, uint32 filters, const float* u, const float* v, const FusedBatchOutput<RGBF32>& out, size_t count)
+{
+    SampleFusedBatchLinear(texture, mip, filters, u, v, out, count);
+}
+
+inline void SampleFusedBatch(const ImageMipsT<RGBF16>& texture, float mip, uint32 filters, const float* u, const float* v, const FusedBatchOutput<RGBF32>& out, size_t count)
+{
+    SampleFusedBatchLinear(texture, mip, filters, u, v, out, count);
+}
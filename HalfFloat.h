@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string.h>
+
+#include <stdint.h>
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+// IEEE 754 half precision floats, converted with bit manipulation so no special hardware is needed.
+// Rounding is to nearest even, and infinities, NaNs and denormals are all handled.
+
+inline uint16 FloatToHalf(float value)
+{
+    const uint32 c_f32Infinity = 255 << 23;
+    const uint32 c_f16Max = (127 + 16) << 23;
+    const uint32 c_denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32 sign = bits & 0x80000000;
+    bits ^= sign;
+
+    uint16 ret;
+    if (bits >= c_f16Max)
+    {
+        // too big for a half becomes infinity, and NaN stays NaN
+        ret = (bits > c_f32Infinity) ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < (113 << 23))
+    {
+        // too small to be a normalized half, so let the float adder do the rounding into a denormal
+        float magic;
+        memcpy(&magic, &c_denormMagic, sizeof(magic));
+        float shifted;
+        memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += magic;
+        memcpy(&bits, &shifted, sizeof(bits));
+        ret = uint16(bits - c_denormMagic);
+    }
+    else
+    {
+        // rebias the exponent and round the mantissa to nearest even
+        uint32 mantissaOdd = (bits >> 13) & 1;
+        bits += (uint32(15 - 127) << 23) + 0xfff;
+        bits += mantissaOdd;
+        ret = uint16(bits >> 13);
+    }
+
+    return ret | uint16(sign >> 16);
+}
+
+inline float HalfToFloat(uint16 value)
+{
+    const uint32 c_shiftedExponent = 0x7c00 << 13;
+    const uint32 c_magic = 113 << 23;
+
+    uint32 bits = (value & 0x7fff) << 13;
+    uint32 exponent = bits & c_shiftedExponent;
+    bits += (127 - 15) << 23;
+
+    if (exponent == c_shiftedExponent)
+    {
+        // infinity or NaN
+        bits += (128 - 16) << 23;
+    }
+    else if (exponent == 0)
+    {
+        // zero or denormal, renormalize it with a float subtract
+        bits += 1 << 23;
+        float renormalized, magic;
+        memcpy(&renormalized, &bits, sizeof(renormalized));
+        memcpy(&magic, &c_magic, sizeof(magic));
+        renormalized -= magic;
+        memcpy(&bits, &renormalized, sizeof(bits));
+    }
+
+    bits |= uint32(value & 0x8000) << 16;
+
+    float ret;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
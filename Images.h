@@ -1,13 +1,13 @@
 #pragma once
 
 #include "Math.h"
+#include "ColorConversion.h"
+#include "HalfFloat.h"
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
-#include <stdint.h>
-typedef uint8_t uint8;
-typedef uint32_t uint32;
-
 inline float PixelToUV(int pixel, int width)
 {
     // x' = (x+0.5)/w
@@ -38,6 +38,95 @@ enum class SampleType
     LinearMip
 };
 
+// What the samplers do with texel coordinates outside of the image
+enum class AddressMode
+{
+    Wrap,       // repeat the image
+    Clamp,      // use the closest edge texel
+    Mirror,     // repeat the image, flipping every other copy
+    Border      // use a border color of zero
+};
+
+inline bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+// Maps a texel coordinate on one axis into the image, or to -1 for Border when it's outside.
+// The POW2 versions are for when the size is known to be a power of two, and wrap with a mask instead of
+// an integer division. Everything is resolved at compile time, so there's no branching on the mode.
+template <AddressMode MODE, bool POW2>
+struct TexelAddress;
+
+template <bool POW2>
+struct TexelAddress<AddressMode::Wrap, POW2>
+{
+    static int Address(int coord, int size)
+    {
+        if (POW2)
+            return coord & (size - 1);
+        int ret = coord % size;
+        return ret < 0 ? ret + size : ret;
+    }
+};
+
+template <bool POW2>
+struct TexelAddress<AddressMode::Clamp, POW2>
+{
+    static int Address(int coord, int size)
+    {
+        return clamp(coord, 0, size - 1);
+    }
+};
+
+template <bool POW2>
+struct TexelAddress<AddressMode::Mirror, POW2>
+{
+    static int Address(int coord, int size)
+    {
+        int period = size * 2;
+        int ret = TexelAddress<AddressMode::Wrap, POW2>::Address(coord, period);
+        return ret < size ? ret : period - 1 - ret;
+    }
+};
+
+template <bool POW2>
+struct TexelAddress<AddressMode::Border, POW2>
+{
+    static int Address(int coord, int size)
+    {
+        return unsigned(coord) < unsigned(size) ? coord : -1;
+    }
+};
+
+// Wrap keeps the +1 offset UVToPixel() has always had. It doesn't change which texel gets picked, since it's
+// a whole copy of the image, but it keeps results the same as before for uvs above -1. The other modes need
+// the real coordinate.
+template <AddressMode MODE>
+inline float AddressUVOffset()
+{
+    return MODE == AddressMode::Wrap ? 1.0f : 0.0f;
+}
+
+// the texel a uv falls in
+template <AddressMode MODE, bool POW2>
+inline int NearestTexel(float uv, int size)
+{
+    float x = (uv + AddressUVOffset<MODE>()) * float(size);
+    return TexelAddress<MODE, POW2>::Address(int(std::floor(x)), size);
+}
+
+// the two texels to interpolate between for a uv, and the weight of the second one
+template <AddressMode MODE, bool POW2>
+inline void BilinearTexels(float uv, int size, int& coord0, int& coord1, float& fract)
+{
+    float x = (uv + AddressUVOffset<MODE>()) * float(size) - 0.5f;
+    float floorX = std::floor(x);
+    fract = x - floorX;
+    coord0 = TexelAddress<MODE, POW2>::Address(int(floorX), size);
+    coord1 = TexelAddress<MODE, POW2>::Address(int(floorX) + 1, size);
+}
+
 struct RGBU8
 {
     uint8 r = 0;
@@ -86,76 +175,509 @@ inline RGBU8 operator + (const RGBU8& a, const RGBU8& b)
     return ret;
 }
 
-struct Image
+// A linear color stored as half floats, for half the memory of RGBF32
+struct RGBF16
 {
-    int width, height;
-    std::vector<RGBU8> pixels;
+    uint16 r = 0;
+    uint16 g = 0;
+    uint16 b = 0;
 };
 
-typedef std::vector<Image> ImageMips;
+inline RGBF32 operator * (const RGBF32& a, float f)
+{
+    RGBF32 ret;
+    ret.r = a.r * f;
+    ret.g = a.g * f;
+    ret.b = a.b * f;
+    return ret;
+}
 
-inline RGBU8 SampleNearest (const Image& image, const Vector2& uv)
+inline RGBF32 operator + (const RGBF32& a, const RGBF32& b)
 {
-    int x = UVToPixel(uv[0], image.width) % image.width;
-    int y = UVToPixel(uv[1], image.height) % image.height;
+    RGBF32 ret;
+    ret.r = a.r + b.r;
+    ret.g = a.g + b.g;
+    ret.b = a.b + b.b;
+    return ret;
+}
 
-    return image.pixels[y*image.width + x];
+inline RGBF32 RGB_U8_To_F32(const RGBU8& rgbu8, const ColorTables& tables)
+{
+    RGBF32 ret;
+    ret.r = DecodeToLinear(tables, rgbu8.r);
+    ret.g = DecodeToLinear(tables, rgbu8.g);
+    ret.b = DecodeToLinear(tables, rgbu8.b);
+    return ret;
 }
 
-inline RGBU8 SampleBilinear(const Image& image, const Vector2& uv)
+inline RGBU8 RGB_F32_To_U8(const RGBF32& rgbf32, const ColorTables& tables)
 {
-    float xweight, yweight;
+    RGBU8 ret;
+    ret.r = EncodeFromLinear(tables, rgbf32.r);
+    ret.g = EncodeFromLinear(tables, rgbf32.g);
+    ret.b = EncodeFromLinear(tables, rgbf32.b);
+    return ret;
+}
 
-    int x0 = UVToPixel(uv[0], image.width, xweight) % image.width;
-    int y0 = UVToPixel(uv[1], image.height, yweight) % image.height;
-    int x1 = (x0 + 1) % image.width;
-    int y1 = (y0 + 1) % image.height;
+// using a gamma of 2.2
+inline RGBF32 RGB_U8_To_F32(const RGBU8& rgbu8)
+{
+    return RGB_U8_To_F32(rgbu8, GetColorTables(ColorCurve::Gamma22));
+}
 
-    RGBU8 p00 = image.pixels[y0*image.width + x0];
-    RGBU8 p10 = image.pixels[y0*image.width + x1];
-    RGBU8 p01 = image.pixels[y1*image.width + x0];
-    RGBU8 p11 = image.pixels[y1*image.width + x1];
+inline RGBU8 RGB_F32_To_U8(const RGBF32& rgbf32)
+{
+    return RGB_F32_To_U8(rgbf32, GetColorTables(ColorCurve::Gamma22));
+}
 
-    RGBU8 px0 = lerp(p00, p10, xweight);
-    RGBU8 px1 = lerp(p01, p11, xweight);
+// Describes how the samplers and mip makers read and write each texel format.
+// RGBU8 is sRGB encoded, and the samplers filter it as is, in sRGB space.
+// RGBF32 and RGBF16 hold linear values, which the samplers filter as RGBF32 with no conversion to or from sRGB.
+template <typename TEXEL>
+struct TexelTraits;
 
-    return lerp(px0, px1, yweight);
+template <>
+struct TexelTraits<RGBU8>
+{
+    typedef RGBU8 Filtered;
+    static RGBU8 Fetch(const RGBU8& texel) { return texel; }
+    static RGBF32 ToLinear(const RGBU8& texel, const ColorTables& tables) { return RGB_U8_To_F32(texel, tables); }
+    static RGBU8 FromLinear(const RGBF32& linear, const ColorTables& tables) { return RGB_F32_To_U8(linear, tables); }
+};
+
+template <>
+struct TexelTraits<RGBF32>
+{
+    typedef RGBF32 Filtered;
+    static RGBF32 Fetch(const RGBF32& texel) { return texel; }
+    static RGBF32 ToLinear(const RGBF32& texel, const ColorTables&) { return texel; }
+    static RGBF32 FromLinear(const RGBF32& linear, const ColorTables&) { return linear; }
+};
+
+template <>
+struct TexelTraits<RGBF16>
+{
+    typedef RGBF32 Filtered;
+
+    static RGBF32 Fetch(const RGBF16& texel)
+    {
+        RGBF32 ret;
+        ret.r = HalfToFloat(texel.r);
+        ret.g = HalfToFloat(texel.g);
+        ret.b = HalfToFloat(texel.b);
+        return ret;
+    }
+
+    static RGBF32 ToLinear(const RGBF16& texel, const ColorTables&) { return Fetch(texel); }
+
+    static RGBF16 FromLinear(const RGBF32& linear, const ColorTables&)
+    {
+        RGBF16 ret;
+        ret.r = FloatToHalf(linear.r);
+        ret.g = FloatToHalf(linear.g);
+        ret.b = FloatToHalf(linear.b);
+        return ret;
+    }
+};
+
+// for turning filtered results into pixels that can be saved out
+inline RGBU8 ToDisplay(const RGBU8& color)
+{
+    return color;
 }
 
-inline RGBU8 SampleTrilinear(const ImageMips& texture, const Vector2& uv, float mip)
+inline RGBU8 ToDisplay(const RGBF32& color)
 {
-    RGBU8 bilinearLowMip = SampleBilinear(texture[std::min(int(mip), (int)texture.size() - 1)], uv);
-    RGBU8 bilinearHighMip = SampleBilinear(texture[std::min(int(mip) + 1, (int)texture.size() - 1)], uv);
-    return lerp(bilinearLowMip, bilinearHighMip, std::fmodf(mip, 1.0f));
+    return RGB_F32_To_U8(color);
 }
 
-// using a gamma of 2.2
-inline float sRGBU8_To_LinearFloat(uint8 in)
+inline RGBU8 ToDisplay(const RGBF16& color)
 {
-    float ret = float(in) / 255.0f;
-    return std::powf(ret, 2.2f);
+    return ToDisplay(TexelTraits<RGBF16>::Fetch(color));
 }
 
-inline uint8 LinearFloat_To_sRGBU8(float in)
+// A non owning view of a run of pixels. It has the parts of the std::vector interface that the samplers use,
+// so that the pixels of an image can live inside of a larger allocation.
+template <typename T>
+struct PixelSpan
+{
+    PixelSpan() = default;
+    PixelSpan(T* data, size_t size) : m_data(data), m_size(size) {}
+
+    T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    T* begin() const { return m_data; }
+    T* end() const { return m_data + m_size; }
+    T& operator[] (size_t index) const { return m_data[index]; }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// How the texels of an image are ordered in memory.
+//
+// Row major is the simple order, but a sampler walking across rows (like when the uvs are rotated) touches a
+// new cache line for nearly every texel. The tiled layouts store the image as 8x8 tiles, in row major order
+// of tiles, so that texels near each other on both axes are near each other in memory. Tiles on the right
+// and bottom edges are cut down to fit the image, so the tiled layouts take no more memory than row major.
+//
+// Only the samplers understand the tiled layouts. Mips are made in row major, and can be converted after.
+enum class TexelLayout
+{
+    RowMajor,
+    Tiled,      // 8x8 tiles, with the texels of a tile in row major order
+    Morton      // 8x8 tiles, with the texels of a full tile in Z order. Cut down edge tiles are row major.
+};
+
+static const int c_texelTileShift = 3;
+static const int c_texelTileSize = 1 << c_texelTileShift;
+
+template <typename TEXEL>
+struct ImageT
+{
+    int width = 0;
+    int height = 0;
+    PixelSpan<TEXEL> pixels;
+    TexelLayout layout = TexelLayout::RowMajor;
+};
+
+typedef ImageT<RGBU8> Image;
+
+inline int CalculateMipCount(int width, int height)
 {
-    in = std::powf(in, 1.0f / 2.2f);
-    return uint8(clamp(in * 255.0f + 0.5f, 0.0f, 255.0f));
+    // calculate how many mips we need to make the longer axis reach 1 pixel in size.
+    int largestAxis = std::max(width, height);
+    int numMips = 0;
+    while (largestAxis)
+    {
+        largestAxis = largestAxis >> 1;
+        numMips++;
+    }
+    return numMips;
 }
 
-inline RGBF32 RGB_U8_To_F32(const RGBU8& rgbu8)
+// Where a mip lives in the storage of an ImageMips. Both are in bytes.
+struct MipLevelLayout
 {
-    RGBF32 ret;
-    ret.r = sRGBU8_To_LinearFloat(rgbu8.r);
-    ret.g = sRGBU8_To_LinearFloat(rgbu8.g);
-    ret.b = sRGBU8_To_LinearFloat(rgbu8.b);
-    return ret;
+    size_t offset = 0;
+    size_t rowPitch = 0;
+};
+
+// A full mip chain stored in a single allocation, with each mip starting on a cache line boundary.
+// texture[i] gives the Image for mip i, the same as if it were a std::vector<Image>.
+template <typename TEXEL>
+class ImageMipsT
+{
+public:
+    static const size_t c_alignment = 64;
+
+    ImageMipsT() = default;
+    ImageMipsT(ImageMipsT&&) = default;
+    ImageMipsT& operator = (ImageMipsT&&) = default;
+
+    // the images point into the storage, so copies aren't allowed
+    ImageMipsT(const ImageMipsT&) = delete;
+    ImageMipsT& operator = (const ImageMipsT&) = delete;
+
+    // Sets up the mip sizes and layouts for an image of this size, and allocates the storage for all of them.
+    // Each mip is half the size of the one before it on each axis, but never less than 1 pixel.
+    void Allocate(int width, int height)
+    {
+        size_t storageSize = SetupLayouts(width, height);
+
+        // over allocate so the start can be aligned
+        m_owner.reset();
+        m_storage.clear();
+        m_storage.resize(storageSize + c_alignment);
+        m_data = (uint8*)AlignUp(size_t(m_storage.data()));
+        m_storageSize = storageSize;
+
+        SetupImages();
+    }
+
+    // Same as Allocate(), but uses storage that lives somewhere else, like a memory mapped file. The data
+    // needs to be aligned, and laid out the same way Allocate() would lay it out. The owner is held on to
+    // for as long as the storage is in use.
+    void UseStorage(int width, int height, uint8* data, std::shared_ptr<void> owner)
+    {
+        m_storageSize = SetupLayouts(width, height);
+        m_storage.clear();
+        m_storage.shrink_to_fit();
+        m_owner = owner;
+        m_data = data;
+
+        SetupImages();
+    }
+
+    // Sets up the mip sizes and layouts without any storage, for code that only needs to know where
+    // everything would go, like when writing mips straight to a file. The images have no pixels.
+    void SetupLayoutsOnly(int width, int height)
+    {
+        m_storageSize = SetupLayouts(width, height);
+        m_storage.clear();
+        m_storage.shrink_to_fit();
+        m_owner.reset();
+        m_data = nullptr;
+
+        for (ImageT<TEXEL>& image : m_images)
+            image.pixels = PixelSpan<TEXEL>();
+    }
+
+    size_t size() const { return m_images.size(); }
+    bool empty() const { return m_images.empty(); }
+
+    ImageT<TEXEL>& operator[] (size_t index) { return m_images[index]; }
+    const ImageT<TEXEL>& operator[] (size_t index) const { return m_images[index]; }
+
+    typename std::vector<ImageT<TEXEL>>::const_iterator begin() const { return m_images.begin(); }
+    typename std::vector<ImageT<TEXEL>>::const_iterator end() const { return m_images.end(); }
+
+    const MipLevelLayout& Layout(size_t index) const { return m_layouts[index]; }
+
+    // the single allocation that holds every mip
+    uint8* Data() { return m_data; }
+    const uint8* Data() const { return m_data; }
+    size_t DataSize() const { return m_storageSize; }
+
+    static size_t AlignUp(size_t value)
+    {
+        return (value + c_alignment - 1) & ~(c_alignment - 1);
+    }
+
+private:
+    // Sets up the sizes and layouts of the mips, and returns how much storage they need.
+    // Every mip is padded out to the alignment, including the last 1x1 mip, so reading a few bytes past any
+    // texel stays inside the storage. The batch samplers rely on this for their 4 byte gathers.
+    size_t SetupLayouts(int width, int height)
+    {
+        int numMips = CalculateMipCount(width, height);
+        m_images.resize(numMips);
+        m_layouts.resize(numMips);
+
+        size_t storageSize = 0;
+        for (int mipIndex = 0; mipIndex < numMips; ++mipIndex)
+        {
+            ImageT<TEXEL>& image = m_images[mipIndex];
+            image.width = (mipIndex == 0) ? width : std::max(m_images[mipIndex - 1].width / 2, 1);
+            image.height = (mipIndex == 0) ? height : std::max(m_images[mipIndex - 1].height / 2, 1);
+            image.layout = TexelLayout::RowMajor;
+
+            m_layouts[mipIndex].offset = storageSize;
+            m_layouts[mipIndex].rowPitch = image.width * sizeof(TEXEL);
+            storageSize += AlignUp(image.height * m_layouts[mipIndex].rowPitch);
+        }
+        return storageSize;
+    }
+
+    // points the images at their place in the storage
+    void SetupImages()
+    {
+        for (size_t mipIndex = 0; mipIndex < m_images.size(); ++mipIndex)
+        {
+            ImageT<TEXEL>& image = m_images[mipIndex];
+            image.pixels = PixelSpan<TEXEL>((TEXEL*)(m_data + m_layouts[mipIndex].offset), size_t(image.width) * size_t(image.height));
+        }
+    }
+
+    std::vector<ImageT<TEXEL>> m_images;
+    std::vector<MipLevelLayout> m_layouts;
+    std::vector<uint8> m_storage;
+    std::shared_ptr<void> m_owner;
+    uint8* m_data = nullptr;
+    size_t m_storageSize = 0;
+};
+
+typedef ImageMipsT<RGBU8> ImageMips;
+
+// Whether the whole mip chain can be sampled with the POW2 wrapping. Halving a power of two, and stopping at 1,
+// always gives another power of two, so only the top mip needs checking.
+template <typename TEXEL>
+inline bool IsPowerOfTwo(const ImageMipsT<TEXEL>& texture)
+{
+    return texture.size() > 0 && IsPowerOfTwo(texture[0].width) && IsPowerOfTwo(texture[0].height);
 }
 
-inline RGBU8 RGB_F32_To_U8(const RGBF32& rgbf32)
+// Reorders the texels of an image in place, for when it's going to be sampled a lot in a way that the new
+// layout suits better.
+template <typename TEXEL>
+inline void ConvertTexelLayout(ImageT<TEXEL>& image, TexelLayout layout)
 {
-    RGBU8 ret;
-    ret.r = LinearFloat_To_sRGBU8(rgbf32.r);
-    ret.g = LinearFloat_To_sRGBU8(rgbf32.g);
-    ret.b = LinearFloat_To_sRGBU8(rgbf32.b);
-    return ret;
+    if (image.layout == layout)
+        return;
+
+    ImageT<TEXEL> converted = image;
+    converted.layout = layout;
+
+    std::vector<TEXEL> texels(image.pixels.begin(), image.pixels.end());
+    for (int y = 0; y < image.height; ++y)
+        for (int x = 0; x < image.width; ++x)
+            converted.pixels[TexelIndex(converted, x, y)] = texels[TexelIndex(image, x, y)];
+
+    image = converted;
+}
+
+// Converts every mip. This is done after the mips are made, since the mip makers need row major.
+template <typename TEXEL>
+inline void ConvertTexelLayout(ImageMipsT<TEXEL>& mips, TexelLayout layout)
+{
+    for (size_t mipIndex = 0; mipIndex < mips.size(); ++mipIndex)
+        ConvertTexelLayout(mips[mipIndex], layout);
+}
+
+// Samplers. The address mode and whether the image sizes are powers of two are template parameters, which
+// default to wrapping any size of image.
+
+// spreads the low 3 bits of a value out to every other bit
+inline int MortonSpread3(int value)
+{
+    value = (value | (value << 2)) & 0x13;
+    return (value | (value << 1)) & 0x15;
+}
+
+// where the texel at (x, y) is stored in an image's pixels
+template <typename TEXEL>
+inline size_t TexelIndex(const ImageT<TEXEL>& image, int x, int y)
+{
+    if (image.layout == TexelLayout::RowMajor)
+        return size_t(y) * image.width + x;
+
+    int tileX = x >> c_texelTileShift;
+    int tileY = y >> c_texelTileShift;
+    int inTileX = x & (c_texelTileSize - 1);
+    int inTileY = y & (c_texelTileSize - 1);
+
+    // the common case of every tile being full sized
+    if (((image.width | image.height) & (c_texelTileSize - 1)) == 0)
+    {
+        size_t tileStart = (size_t(tileY) * (image.width >> c_texelTileShift) + tileX) << (c_texelTileShift * 2);
+        if (image.layout == TexelLayout::Morton)
+            return tileStart + (MortonSpread3(inTileX) | (MortonSpread3(inTileY) << 1));
+        return tileStart + ((inTileY << c_texelTileShift) | inTileX);
+    }
+
+    int tileWidth = std::min(c_texelTileSize, image.width - (tileX << c_texelTileShift));
+    int tileHeight = std::min(c_texelTileSize, image.height - (tileY << c_texelTileShift));
+
+    // the tiles above this row of tiles are all full height, and the tiles to the left are all full width
+    size_t tileStart = size_t(tileY << c_texelTileShift) * image.width + size_t(tileX << c_texelTileShift) * tileHeight;
+
+    if (image.layout == TexelLayout::Morton && tileWidth == c_texelTileSize && tileHeight == c_texelTileSize)
+        return tileStart + (MortonSpread3(inTileX) | (MortonSpread3(inTileY) << 1));
+    return tileStart + inTileY * tileWidth + inTileX;
+}
+
+// A hook that gets told about every texel the samplers read, for instrumentation like TexelCacheSim.h.
+// It's per thread, and is empty unless something is recording.
+typedef void (*TexelReadCallback)(void* context, const void* address, size_t size);
+
+struct TexelReadHook
+{
+    TexelReadCallback callback = nullptr;
+    void* context = nullptr;
+};
+
+inline TexelReadHook& CurrentTexelReadHook()
+{
+    static thread_local TexelReadHook s_hook;
+    return s_hook;
+}
+
+// every texel read by the samplers goes through here
+template <typename TEXEL>
+inline const TEXEL& ReadTexel(const ImageT<TEXEL>& image, int x, int y)
+{
+    const TEXEL& texel = image.pixels[TexelIndex(image, x, y)];
+
+    const TexelReadHook& hook = CurrentTexelReadHook();
+    if (hook.callback)
+        hook.callback(hook.context, &texel, sizeof(TEXEL));
+
+    return texel;
+}
+
+// reads a texel, or the border color if either coordinate is outside the image
+template <AddressMode MODE, typename TEXEL>
+inline typename TexelTraits<TEXEL>::Filtered FetchTexel(const ImageT<TEXEL>& image, int x, int y)
+{
+    if (MODE == AddressMode::Border && (x < 0 || y < 0))
+        return typename TexelTraits<TEXEL>::Filtered();
+    return TexelTraits<TEXEL>::Fetch(ReadTexel(image, x, y));
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline TEXEL SampleNearest (const ImageT<TEXEL>& image, const Vector2& uv)
+{
+    int x = NearestTexel<MODE, POW2>(uv[0], image.width);
+    int y = NearestTexel<MODE, POW2>(uv[1], image.height);
+
+    if (MODE == AddressMode::Border && (x < 0 || y < 0))
+        return TEXEL();
+    return ReadTexel(image, x, y);
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline typename TexelTraits<TEXEL>::Filtered SampleBilinear(const ImageT<TEXEL>& image, const Vector2& uv)
+{
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    int x0, x1, y0, y1;
+    float xweight, yweight;
+    BilinearTexels<MODE, POW2>(uv[0], image.width, x0, x1, xweight);
+    BilinearTexels<MODE, POW2>(uv[1], image.height, y0, y1, yweight);
+
+    Filtered p00 = FetchTexel<MODE>(image, x0, y0);
+    Filtered p10 = FetchTexel<MODE>(image, x1, y0);
+    Filtered p01 = FetchTexel<MODE>(image, x0, y1);
+    Filtered p11 = FetchTexel<MODE>(image, x1, y1);
+
+    Filtered px0 = lerp(p00, p10, xweight);
+    Filtered px1 = lerp(p01, p11, xweight);
+
+    return lerp(px0, px1, yweight);
+}
+
+template <AddressMode MODE = AddressMode::Wrap, bool POW2 = false, typename TEXEL>
+inline typename TexelTraits<TEXEL>::Filtered SampleTrilinear(const ImageMipsT<TEXEL>& texture, const Vector2& uv, float mip)
+{
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    Filtered bilinearLowMip = SampleBilinear<MODE, POW2>(texture[std::min(int(mip), (int)texture.size() - 1)], uv);
+    Filtered bilinearHighMip = SampleBilinear<MODE, POW2>(texture[std::min(int(mip) + 1, (int)texture.size() - 1)], uv);
+    return lerp(bilinearLowMip, bilinearHighMip, std::fmodf(mip, 1.0f));
 }
+
+// A sampler with the filter picked at compile time too, for code that is templated on all of the choices.
+// The mip is ignored by the filters that don't use it.
+template <SampleType FILTER, AddressMode MODE = AddressMode::Wrap, bool POW2 = false>
+struct Sampler;
+
+template <AddressMode MODE, bool POW2>
+struct Sampler<SampleType::Nearest, MODE, POW2>
+{
+    template <typename TEXEL>
+    static typename TexelTraits<TEXEL>::Filtered Sample(const ImageMipsT<TEXEL>& texture, const Vector2& uv, float mip)
+    {
+        return TexelTraits<TEXEL>::Fetch(SampleNearest<MODE, POW2>(texture[std::min(int(mip), (int)texture.size() - 1)], uv));
+    }
+};
+
+template <AddressMode MODE, bool POW2>
+struct Sampler<SampleType::Linear, MODE, POW2>
+{
+    template <typename TEXEL>
+    static typename TexelTraits<TEXEL>::Filtered Sample(const ImageMipsT<TEXEL>& texture, const Vector2& uv, float mip)
+    {
+        return SampleBilinear<MODE, POW2>(texture[std::min(int(mip), (int)texture.size() - 1)], uv);
+    }
+};
+
+template <AddressMode MODE, bool POW2>
+struct Sampler<SampleType::LinearMip, MODE, POW2>
+{
+    template <typename TEXEL>
+    static typename TexelTraits<TEXEL>::Filtered Sample(const ImageMipsT<TEXEL>& texture, const Vector2& uv, float mip)
+    {
+        return SampleTrilinear<MODE, POW2>(texture, uv, mip);
+    }
+};
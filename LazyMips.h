@@ -0,0 +1,178 @@
+#pragma once
+
+#include "Mips.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A mip chain that only makes the parts of mips 1 and up that get used.
+//
+// Each mip is split into tiles, and a tile is made the first time a sampler reads from it, which first makes
+// whatever tiles of the mip above it are needed. Tiles are made with the same box filter as MakeMips, so
+// the results are the same as making the whole chain up front.
+//
+// Tiles are safe to make from many threads at once. If two threads want the same tile, one makes it while
+// the other waits for it.
+class LazyImageMips
+{
+public:
+    static const int c_tileSize = 32;
+
+    LazyImageMips(const uint8* pixels, int width, int height, ColorCurve curve = ColorCurve::Gamma22)
+        : m_colorTables(GetColorTables(curve))
+    {
+        m_mips.Allocate(width, height);
+        memcpy(m_mips[0].pixels.data(), pixels, width*height * sizeof(RGBU8));
+
+        m_levels.resize(m_mips.size());
+        for (size_t mipIndex = 0; mipIndex < m_mips.size(); ++mipIndex)
+        {
+            std::unique_ptr<LevelState>& level = m_levels[mipIndex];
+            level.reset(new LevelState);
+            level->tilesX = (m_mips[mipIndex].width + c_tileSize - 1) / c_tileSize;
+            level->tilesY = (m_mips[mipIndex].height + c_tileSize - 1) / c_tileSize;
+
+            int tileCount = level->tilesX * level->tilesY;
+            level->tileReady.reset(new std::atomic<bool>[tileCount]);
+            level->tileOnce.reset(new std::once_flag[tileCount]);
+
+            // mip 0 is the source image, so it's always ready
+            for (int tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+                level->tileReady[tileIndex].store(mipIndex == 0);
+        }
+    }
+
+    size_t size() const { return m_mips.size(); }
+
+    // The image of a mip, which is only valid in the places that have been made.
+    const Image& Level(int mipIndex) const { return m_mips[mipIndex]; }
+
+    // makes sure the tile holding this pixel is made, for samplers to call before reading the pixel
+    void EnsurePixel(int mipIndex, int x, int y)
+    {
+        LevelState& level = *m_levels[mipIndex];
+        if (!level.touched.load(std::memory_order_relaxed))
+            level.touched.store(true, std::memory_order_relaxed);
+
+        EnsureTile(mipIndex, x / c_tileSize, y / c_tileSize);
+    }
+
+    // makes the whole mip, for when it's going to be read a lot or handed to code that doesn't know about tiles
+    const Image& EnsureLevel(int mipIndex)
+    {
+        m_levels[mipIndex]->touched.store(true, std::memory_order_relaxed);
+        EnsureRect(mipIndex, 0, 0, m_mips[mipIndex].width, m_mips[mipIndex].height);
+        return m_mips[mipIndex];
+    }
+
+    // Counters, to see which mips actually got used
+    bool LevelTouched(int mipIndex) const { return m_levels[mipIndex]->touched.load(); }
+    int TilesMade(int mipIndex) const { return m_levels[mipIndex]->tilesMade.load(); }
+    int TileCount(int mipIndex) const { return m_levels[mipIndex]->tilesX * m_levels[mipIndex]->tilesY; }
+
+private:
+    struct LevelState
+    {
+        int tilesX = 0;
+        int tilesY = 0;
+        std::unique_ptr<std::atomic<bool>[]> tileReady;
+        std::unique_ptr<std::once_flag[]> tileOnce;
+        std::atomic<int> tilesMade = { 0 };
+        std::atomic<bool> touched = { false };
+    };
+
+    void EnsureTile(int mipIndex, int tileX, int tileY)
+    {
+        LevelState& level = *m_levels[mipIndex];
+        int tileIndex = tileY * level.tilesX + tileX;
+
+        // the flag check keeps the common case down to a single load
+        if (level.tileReady[tileIndex].load(std::memory_order_acquire))
+            return;
+
+        std::call_once(level.tileOnce[tileIndex],
+            [&]()
+            {
+                MakeTile(mipIndex, tileX, tileY);
+                level.tilesMade++;
+                level.tileReady[tileIndex].store(true, std::memory_order_release);
+            }
+        );
+    }
+
+    // makes sure every tile touching [x0, x1) x [y0, y1) is made
+    void EnsureRect(int mipIndex, int x0, int y0, int x1, int y1)
+    {
+        for (int tileY = y0 / c_tileSize; tileY <= (y1 - 1) / c_tileSize; ++tileY)
+            for (int tileX = x0 / c_tileSize; tileX <= (x1 - 1) / c_tileSize; ++tileX)
+                EnsureTile(mipIndex, tileX, tileY);
+    }
+
+    void MakeTile(int mipIndex, int tileX, int tileY)
+    {
+        const Image& src = m_mips[mipIndex - 1];
+        Image& dest = m_mips[mipIndex];
+        int widthRatio = src.width / dest.width;
+        int heightRatio = src.height / dest.height;
+
+        int x0 = tileX * c_tileSize;
+        int y0 = tileY * c_tileSize;
+        int x1 = std::min(x0 + c_tileSize, dest.width);
+        int y1 = std::min(y0 + c_tileSize, dest.height);
+
+        // the source pixels need to be there first. This recurses up to mip 0 as needed.
+        EnsureRect(mipIndex - 1, x0 * widthRatio, y0 * heightRatio, x1 * widthRatio, y1 * heightRatio);
+
+        DownsampleBoxRect(src, dest, x0, y0, x1, y1, m_colorTables);
+    }
+
+    ImageMips m_mips;
+    const ColorTables& m_colorTables;
+    std::vector<std::unique_ptr<LevelState>> m_levels;
+};
+
+// Samplers for lazy mips. These work out which pixels they are going to read, make sure they are made, and
+// then sample as usual.
+
+inline RGBU8 SampleNearest(LazyImageMips& texture, int mipIndex, const Vector2& uv)
+{
+    const Image& image = texture.Level(mipIndex);
+    int x = NearestTexel<AddressMode::Wrap, false>(uv[0], image.width);
+    int y = NearestTexel<AddressMode::Wrap, false>(uv[1], image.height);
+
+    texture.EnsurePixel(mipIndex, x, y);
+    return ReadTexel(image, x, y);
+}
+
+inline RGBU8 SampleBilinear(LazyImageMips& texture, int mipIndex, const Vector2& uv)
+{
+    const Image& image = texture.Level(mipIndex);
+
+    int x0, x1, y0, y1;
+    float xweight, yweight;
+    BilinearTexels<AddressMode::Wrap, false>(uv[0], image.width, x0, x1, xweight);
+    BilinearTexels<AddressMode::Wrap, false>(uv[1], image.height, y0, y1, yweight);
+
+    // these are usually all in the same tile, which makes the later calls a single load each
+    texture.EnsurePixel(mipIndex, x0, y0);
+    texture.EnsurePixel(mipIndex, x1, y0);
+    texture.EnsurePixel(mipIndex, x0, y1);
+    texture.EnsurePixel(mipIndex, x1, y1);
+
+    return SampleBilinear(image, uv);
+}
+
+inline RGBU8 SampleTrilinear(LazyImageMips& texture, const Vector2& uv, float mip)
+{
+    float mipFract = std::fmodf(mip, 1.0f);
+    RGBU8 bilinearLowMip = SampleBilinear(texture, std::min(int(mip), (int)texture.size() - 1), uv);
+
+    // a whole mip doesn't need the next one, which would get made just to be given a weight of 0
+    if (!(mipFract > 0.0f))
+        return bilinearLowMip;
+
+    RGBU8 bilinearHighMip = SampleBilinear(texture, std::min(int(mip) + 1, (int)texture.size() - 1), uv);
+    return lerp(bilinearLowMip, bilinearHighMip, mipFract);
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include "Images.h"
+#include "MipFilters.h"
+#include "Mips.h"
+
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdint.h>
+typedef uint64_t uint64;
+
+// A binary file holding a whole mip chain, so that later runs can memory map it instead of decoding the
+// source image and making the mips again.
+//
+// The file is:
+//   MipCacheHeader
+//   MipCacheLevel for each mip
+//   padding up to a multiple of ImageMips::c_alignment
+//   the storage of the ImageMips, exactly as it is in memory
+//
+// Values are stored in the byte order of the machine that wrote the file.
+//
+// The cache key is a hash of the source file and the settings used to make the mips, so if either changes,
+// the cache file gets ignored.
+
+//-------------------------------------------------------------------------------------------------------
+// Hashing
+
+// 64 bit FNV-1a over 8 byte words, with a final mix so that every input bit affects every output bit.
+inline uint64 HashBytes(const void* data, size_t size, uint64 hash = 14695981039346656037ull)
+{
+    const uint64 c_prime = 1099511628211ull;
+    const uint8* bytes = (const uint8*)data;
+
+    size_t index = 0;
+    for (; index + 8 <= size; index += 8)
+    {
+        uint64 word;
+        memcpy(&word, &bytes[index], sizeof(word));
+        hash = (hash ^ word) * c_prime;
+    }
+    for (; index < size; ++index)
+        hash = (hash ^ bytes[index]) * c_prime;
+
+    hash ^= size;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// How the mips were made. Anything that changes the contents of the mips needs to be in here so that it
+// changes the cache key.
+enum class MipGenerator
+{
+    MakeMips,
+    MakeMipsSinglePass,
+    MakeMipsFiltered
+};
+
+struct MipSettings
+{
+    MipGenerator generator = MipGenerator::MakeMips;
+    MipFilter filter = MipFilter::Box;  // only used by MakeMipsFiltered
+    ColorCurve curve = ColorCurve::Gamma22;
+};
+
+// makes the mips with whichever generator the settings ask for
+inline void MakeMipsWithSettings(ImageMips& mips, const uint8* pixels, int width, int height, const MipSettings& settings, ThreadPool& threadPool = GetThreadPool())
+{
+    switch (settings.generator)
+    {
+        case MipGenerator::MakeMipsSinglePass: MakeMipsSinglePass(mips, pixels, width, height, settings.curve, threadPool); break;
+        case MipGenerator::MakeMipsFiltered: MakeMipsFiltered(mips, pixels, width, height, settings.filter, settings.curve, threadPool); break;
+        default: MakeMips(mips, pixels, width, height, settings.curve, threadPool); break;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Memory mapped files
+
+// A read only file mapped into memory. Pages are mapped copy on write, so the mapped memory can be written
+// to without changing the file.
+class MappedFile
+{
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    // returns nullptr if the file can't be opened or mapped
+    static std::shared_ptr<MappedFile> Open(const char* fileName)
+    {
+        std::shared_ptr<MappedFile> ret(new MappedFile);
+#ifdef _WIN32
+        ret->m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (ret->m_file == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(ret->m_file, &size) || size.QuadPart == 0)
+            return nullptr;
+        ret->m_size = size_t(size.QuadPart);
+
+        ret->m_mapping = CreateFileMappingA(ret->m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (ret->m_mapping == nullptr)
+            return nullptr;
+
+        ret->m_data = (uint8*)MapViewOfFile(ret->m_mapping, FILE_MAP_COPY, 0, 0, 0);
+        if (ret->m_data == nullptr)
+            return nullptr;
+#else
+        ret->m_file = open(fileName, O_RDONLY);
+        if (ret->m_file < 0)
+            return nullptr;
+
+        struct stat fileStat;
+        if (fstat(ret->m_file, &fileStat) != 0 || fileStat.st_size == 0)
+            return nullptr;
+        ret->m_size = size_t(fileStat.st_size);
+
+        void* data = mmap(nullptr, ret->m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, ret->m_file, 0);
+        if (data == MAP_FAILED)
+            return nullptr;
+        ret->m_data = (uint8*)data;
+#endif
+        return ret;
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_file >= 0)
+            close(m_file);
+#endif
+    }
+
+    uint8* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    MappedFile() = default;
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    uint8* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Hashes the source file along with the settings. Returns 0 if the file can't be read.
+inline uint64 MakeMipCacheKey(const char* sourceFileName, const MipSettings& settings)
+{
+    std::shared_ptr<MappedFile> sourceFile = MappedFile::Open(sourceFileName);
+    if (!sourceFile)
+        return 0;
+
+    uint64 settingsValues[3] = { uint64(settings.generator), uint64(settings.filter), uint64(settings.curve) };
+    uint64 key = HashBytes(settingsValues, sizeof(settingsValues));
+    return HashBytes(sourceFile->Data(), sourceFile->Size(), key);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Reading and writing
+
+static const uint32 c_mipCacheMagic = 0x50494d52; // "RMIP"
+static const uint32 c_mipCacheVersion = 1;
+
+struct MipCacheHeader
+{
+    uint32 magic = c_mipCacheMagic;
+    uint32 version = c_mipCacheVersion;
+    uint64 key = 0;
+    uint32 width = 0;
+    uint32 height = 0;
+    uint32 texelSize = 0;
+    uint32 mipCount = 0;
+    uint64 dataOffset = 0;
+    uint64 dataSize = 0;
+};
+
+struct MipCacheLevel
+{
+    uint32 width = 0;
+    uint32 height = 0;
+    uint64 offset = 0;
+    uint64 rowPitch = 0;
+};
+
+// where the mip storage starts in a cache file
+template <typename TEXEL>
+inline uint64 MipCacheDataOffset(const ImageMipsT<TEXEL>& mips)
+{
+    return ImageMipsT<TEXEL>::AlignUp(sizeof(MipCacheHeader) + mips.size() * sizeof(MipCacheLevel));
+}
+
+// Writes the header, the layout table and the padding, leaving the file at the start of the mip storage.
+template <typename TEXEL>
+inline bool WriteMipCacheHeader(FILE* file, const ImageMipsT<TEXEL>& mips, uint64 key)
+{
+    MipCacheHeader header;
+    header.key = key;
+    header.width = mips[0].width;
+    header.height = mips[0].height;
+    header.texelSize = sizeof(TEXEL);
+    header.mipCount = uint32(mips.size());
+    header.dataOffset = MipCacheDataOffset(mips);
+    header.dataSize = mips.DataSize();
+
+    std::vector<MipCacheLevel> levels(mips.size());
+    for (size_t mipIndex = 0; mipIndex < mips.size(); ++mipIndex)
+    {
+        levels[mipIndex].width = mips[mipIndex].width;
+        levels[mipIndex].height = mips[mipIndex].height;
+        levels[mipIndex].offset = mips.Layout(mipIndex).offset;
+        levels[mipIndex].rowPitch = mips.Layout(mipIndex).rowPitch;
+    }
+
+    std::vector<uint8> padding(header.dataOffset - sizeof(MipCacheHeader) - levels.size() * sizeof(MipCacheLevel), 0);
+
+    bool ret = fwrite(&header, sizeof(header), 1, file) == 1;
+    ret = ret && fwrite(levels.data(), sizeof(MipCacheLevel), levels.size(), file) == levels.size();
+    ret = ret && (padding.empty() || fwrite(padding.data(), padding.size(), 1, file) == 1);
+    return ret;
+}
+
+template <typename TEXEL>
+inline bool SaveMipCache(const char* fileName, const ImageMipsT<TEXEL>& mips, uint64 key)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (!file)
+        return false;
+
+    bool ret = WriteMipCacheHeader(file, mips, key);
+    ret = ret && fwrite(mips.Data(), mips.DataSize(), 1, file) == 1;
+    ret = (fclose(file) == 0) && ret;
+
+    // don't leave a partial file around to be found next time
+    if (!ret)
+        remove(fileName);
+    return ret;
+}
+
+// Memory maps the cache file and points the mips at it. Returns false if the file is missing, doesn't match
+// the key, or isn't laid out the way ImageMips expects.
+template <typename TEXEL>
+inline bool LoadMipCache(const char* fileName, uint64 key, ImageMipsT<TEXEL>& mips)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::Open(fileName);
+    if (!file || file->Size() < sizeof(MipCacheHeader))
+        return false;
+
+    MipCacheHeader header;
+    memcpy(&header, file->Data(), sizeof(header));
+    if (header.magic != c_mipCacheMagic || header.version != c_mipCacheVersion || header.key != key || header.texelSize != sizeof(TEXEL))
+        return false;
+    if (header.dataOffset % ImageMipsT<TEXEL>::c_alignment != 0 || header.dataOffset + header.dataSize > file->Size())
+        return false;
+    if (sizeof(MipCacheHeader) + header.mipCount * sizeof(MipCacheLevel) > header.dataOffset)
+        return false;
+
+    mips.UseStorage(header.width, header.height, file->Data() + header.dataOffset, file);
+
+    // the layout has to be exactly what UseStorage() expects
+    bool matches = (mips.size() == header.mipCount) && (mips.DataSize() == header.dataSize);
+    for (size_t mipIndex = 0; matches && mipIndex < mips.size(); ++mipIndex)
+    {
+        MipCacheLevel level;
+        memcpy(&level, file->Data() + sizeof(MipCacheHeader) + mipIndex * sizeof(MipCacheLevel), sizeof(level));
+        matches = level.width == uint32(mips[mipIndex].width) &&
+                  level.height == uint32(mips[mipIndex].height) &&
+                  level.offset == mips.Layout(mipIndex).offset &&
+                  level.rowPitch == mips.Layout(mipIndex).rowPitch;
+    }
+
+    if (!matches)
+        mips = ImageMipsT<TEXEL>();
+    return matches;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Mips.h"
+
+#include <algorithm>
+#include <vector>
+
+// A rectangle of pixels, [x0, x1) x [y0, y1)
+struct PixelRect
+{
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int Width() const { return x1 - x0; }
+    int Height() const { return y1 - y0; }
+    bool Empty() const { return x0 >= x1 || y0 >= y1; }
+    long long Area() const { return Empty() ? 0 : (long long)Width() * (long long)Height(); }
+};
+
+inline PixelRect Union(const PixelRect& a, const PixelRect& b)
+{
+    return PixelRect{ std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+}
+
+// Merges rects together when redoing their bounding box costs no more than redoing them separately, which
+// catches overlapping edits and edits that sit side by side.
+inline void CoalesceRects(std::vector<PixelRect>& rects)
+{
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < rects.size() && !merged; ++i)
+        {
+            for (size_t j = i + 1; j < rects.size(); ++j)
+            {
+                PixelRect both = Union(rects[i], rects[j]);
+                if (both.Area() <= rects[i].Area() + rects[j].Area())
+                {
+                    rects[i] = both;
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Keeps track of which parts of mip 0 have changed since the mips were last made, so that only the pixels of
+// the other mips that depend on those parts need to be made again.
+//
+// Edits are batched up by calling AddDirtyRect() as many times as needed, and then applied with one call to
+// Update(), which coalesces them before doing any work.
+class MipDirtyRegions
+{
+public:
+    // mark a rectangle of mip 0 as changed
+    void AddDirtyRect(int x0, int y0, int x1, int y1)
+    {
+        PixelRect rect{ x0, y0, x1, y1 };
+        if (!rect.Empty())
+            m_rects.push_back(rect);
+    }
+
+    bool Empty() const
+    {
+        return m_rects.empty();
+    }
+
+    // Remakes the pixels of mips 1 and up that are affected by the dirty rects, using the same box filter as
+    // MakeMips, and then clears the dirty rects. Returns how many pixels were remade.
+    long long Update(ImageMips& mips, ColorCurve curve = ColorCurve::Gamma22, ThreadPool& threadPool = GetThreadPool())
+    {
+        const ColorTables& colorTables = GetColorTables(curve);
+        long long pixelsRemade = 0;
+
+        std::vector<PixelRect> rects;
+        rects.swap(m_rects);
+        for (PixelRect& rect : rects)
+            rect = ClipRect(rect, mips[0]);
+
+        for (size_t mipIndex = 1; mipIndex < mips.size() && !rects.empty(); ++mipIndex)
+        {
+            const Image& src = mips[mipIndex - 1];
+            Image& dest = mips[mipIndex];
+            int widthRatio = src.width / dest.width;
+            int heightRatio = src.height / dest.height;
+
+            // A dest pixel x is made from source pixels [x * ratio, x * ratio + ratio), so any dest pixel
+            // that touches a dirty source pixel is dirty. Rects that were apart can touch after shrinking.
+            for (PixelRect& rect : rects)
+            {
+                rect.x0 = rect.x0 / widthRatio;
+                rect.y0 = rect.y0 / heightRatio;
+                rect.x1 = (rect.x1 + widthRatio - 1) / widthRatio;
+                rect.y1 = (rect.y1 + heightRatio - 1) / heightRatio;
+                rect = ClipRect(rect, dest);
+            }
+            rects.erase(std::remove_if(rects.begin(), rects.end(), [](const PixelRect& rect) { return rect.Empty(); }), rects.end());
+            CoalesceRects(rects);
+
+            for (const PixelRect& rect : rects)
+            {
+                pixelsRemade += rect.Area();
+                int bandSize = std::max(rect.Height() / (threadPool.ThreadCount() * 4), 1);
+                threadPool.ParallelFor(rect.Height(), bandSize,
+                    [&](int begin, int end)
+                    {
+                        DownsampleBoxRect(src, dest, rect.x0, rect.y0 + begin, rect.x1, rect.y0 + end, colorTables);
+                    }
+                );
+            }
+        }
+        return pixelsRemade;
+    }
+
+private:
+    static PixelRect ClipRect(const PixelRect& rect, const Image& image)
+    {
+        return PixelRect{ std::max(rect.x0, 0), std::max(rect.y0, 0), std::min(rect.x1, image.width), std::min(rect.y1, image.height) };
+    }
+
+    std::vector<PixelRect> m_rects;
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+#include "CPUFeatures.h"
+#include "Images.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include <string.h>
+
+// Mip making with separable filters other than the box filter.
+//
+// Each mip is made from the one before it with a vertical pass and then a horizontal pass. The taps and
+// weights for each axis of each mip are worked out up front, so the passes are just multiply adds.
+//
+// The footprint of a mip pixel is srcSize / destSize source pixels, instead of always being 2. That means
+// the last row or column of an odd sized mip still contributes to the next mip, instead of getting dropped
+// like it does with the box filter in MakeMips. The filters wrap around the edges, the same way the
+// samplers do.
+
+enum class MipFilter
+{
+    Box,
+    Triangle,
+    Mitchell,   // Mitchell-Netravali with B = C = 1/3
+    Lanczos3,
+    Kaiser      // Kaiser windowed sinc, with a radius of 3 and alpha of 4
+};
+
+static const int c_mipFilterCount = 5;
+
+// the names of the filters, in the order of the enum
+static const char* c_mipFilterNames[c_mipFilterCount] = { "box", "triangle", "mitchell", "lanczos3", "kaiser" };
+
+// how far the filter reaches, in destination pixels
+inline float FilterRadius(MipFilter filter)
+{
+    switch (filter)
+    {
+        case MipFilter::Box: return 0.5f;
+        case MipFilter::Triangle: return 1.0f;
+        case MipFilter::Mitchell: return 2.0f;
+        case MipFilter::Lanczos3: return 3.0f;
+        case MipFilter::Kaiser: return 3.0f;
+    }
+    return 0.5f;
+}
+
+inline float Sinc(float x)
+{
+    if (std::fabsf(x) < 1e-6f)
+        return 1.0f;
+    x *= c_pi;
+    return std::sinf(x) / x;
+}
+
+// modified Bessel function of the first kind, order 0, from its power series
+inline float BesselI0(float x)
+{
+    float ret = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x * 0.5f / float(k)) * (x * 0.5f / float(k));
+        ret += term;
+    }
+    return ret;
+}
+
+// the filter kernel, where x is in destination pixels
+inline float FilterKernel(MipFilter filter, float x)
+{
+    switch (filter)
+    {
+        case MipFilter::Box:
+        {
+            // half open so that a pixel exactly on the edge doesn't count for both sides
+            return (x >= -0.5f && x < 0.5f) ? 1.0f : 0.0f;
+        }
+        case MipFilter::Triangle:
+        {
+            return std::max(1.0f - std::fabsf(x), 0.0f);
+        }
+        case MipFilter::Mitchell:
+        {
+            const float B = 1.0f / 3.0f;
+            const float C = 1.0f / 3.0f;
+            x = std::fabsf(x);
+            if (x < 1.0f)
+                return ((12.0f - 9.0f * B - 6.0f * C) * x * x * x + (-18.0f + 12.0f * B + 6.0f * C) * x * x + (6.0f - 2.0f * B)) / 6.0f;
+            if (x < 2.0f)
+                return ((-B - 6.0f * C) * x * x * x + (6.0f * B + 30.0f * C) * x * x + (-12.0f * B - 48.0f * C) * x + (8.0f * B + 24.0f * C)) / 6.0f;
+            return 0.0f;
+        }
+        case MipFilter::Lanczos3:
+        {
+            if (std::fabsf(x) >= 3.0f)
+                return 0.0f;
+            return Sinc(x) * Sinc(x / 3.0f);
+        }
+        case MipFilter::Kaiser:
+        {
+            const float c_radius = 3.0f;
+            const float c_alpha = 4.0f;
+            if (std::fabsf(x) >= c_radius)
+                return 0.0f;
+            float t = x / c_radius;
+            return Sinc(x) * BesselI0(c_alpha * std::sqrtf(1.0f - t * t)) / BesselI0(c_alpha);
+        }
+    }
+    return 0.0f;
+}
+
+// The taps that make each dest pixel along one axis. Every dest pixel has the same number of taps, with the
+// unused ones having a weight of 0.
+struct FilterTaps
+{
+    int tapCount = 0;
+    std::vector<int> sourceIndex;   // [destIndex * tapCount + tap]
+    std::vector<float> weight;      // [destIndex * tapCount + tap]
+};
+
+inline FilterTaps MakeFilterTaps(MipFilter filter, int srcSize, int destSize)
+{
+    // the filter is stretched to cover the footprint of a dest pixel
+    float scale = float(srcSize) / float(destSize);
+    float radius = FilterRadius(filter) * scale;
+
+    // work out the weights of every source pixel in reach, trimming the zeros off of each end
+    std::vector<int> firstIndex(destSize);
+    std::vector<std::vector<float>> weights(destSize);
+    int tapCount = 1;
+    for (int destIndex = 0; destIndex < destSize; ++destIndex)
+    {
+        float center = (float(destIndex) + 0.5f) * scale;
+        int first = int(std::floorf(center - radius));
+        int last = int(std::ceilf(center + radius));
+
+        std::vector<float>& destWeights = weights[destIndex];
+        for (int srcIndex = first; srcIndex <= last; ++srcIndex)
+            destWeights.push_back(FilterKernel(filter, (float(srcIndex) + 0.5f - center) / scale));
+
+        while (destWeights.size() > 1 && destWeights.back() == 0.0f)
+            destWeights.pop_back();
+        while (destWeights.size() > 1 && destWeights.front() == 0.0f)
+        {
+            destWeights.erase(destWeights.begin());
+            first++;
+        }
+
+        firstIndex[destIndex] = first;
+        tapCount = std::max(tapCount, int(destWeights.size()));
+    }
+
+    FilterTaps ret;
+    ret.tapCount = tapCount;
+    ret.sourceIndex.resize(destSize * tapCount);
+    ret.weight.resize(destSize * tapCount, 0.0f);
+    for (int destIndex = 0; destIndex < destSize; ++destIndex)
+    {
+        const std::vector<float>& destWeights = weights[destIndex];
+
+        float total = 0.0f;
+        for (float weight : destWeights)
+            total += weight;
+        if (total == 0.0f)
+            total = 1.0f;
+
+        for (int tap = 0; tap < tapCount; ++tap)
+        {
+            int srcIndex = (firstIndex[destIndex] + tap) % srcSize;
+            if (srcIndex < 0)
+                srcIndex += srcSize;
+            ret.sourceIndex[destIndex * tapCount + tap] = srcIndex;
+            if (tap < int(destWeights.size()))
+                ret.weight[destIndex * tapCount + tap] = destWeights[tap] / total;
+        }
+    }
+    return ret;
+}
+
+// writes a row of linear colors out in the texel format of the mip
+inline void StoreLinearRow(const RGBF32* src, RGBU8* dest, int count, const ColorTables& colorTables)
+{
+    EncodeFromLinear(colorTables, &src[0].r, &dest[0].r, count * 3);
+}
+
+template <typename TEXEL>
+inline void StoreLinearRow(const RGBF32* src, TEXEL* dest, int count, const ColorTables& colorTables)
+{
+    for (int index = 0; index < count; ++index)
+        dest[index] = TexelTraits<TEXEL>::FromLinear(src[index], colorTables);
+}
+
+// converts the sRGB source pixels into the texel format of the mips
+inline void ConvertSourcePixels(const RGBU8* src, RGBU8* dest, int count, const ColorTables&)
+{
+    memcpy(dest, src, count * sizeof(RGBU8));
+}
+
+template <typename TEXEL>
+inline void ConvertSourcePixels(const RGBU8* src, TEXEL* dest, int count, const ColorTables& colorTables)
+{
+    for (int index = 0; index < count; ++index)
+        dest[index] = TexelTraits<TEXEL>::FromLinear(RGB_U8_To_F32(src[index], colorTables), colorTables);
+}
+
+// reads a row of the mip in as linear colors
+inline void LoadLinearRow(const RGBU8* src, RGBF32* dest, int count, const ColorTables& colorTables)
+{
+    DecodeToLinear(colorTables, &src[0].r, &dest[0].r, count * 3);
+}
+
+template <typename TEXEL>
+inline void LoadLinearRow(const TEXEL* src, RGBF32* dest, int count, const ColorTables& colorTables)
+{
+    for (int index = 0; index < count; ++index)
+        dest[index] = TexelTraits<TEXEL>::ToLinear(src[index], colorTables);
+}
+
+// The vertical pass, which adds up the taps of count floats from each of the rows, in tap order
+inline void FilterColumns(const float* const* rows, const float* weights, int tapCount, float* out, int count)
+{
+    int index = 0;
+    if (GetSIMDLevel() >= SIMDLevel::AVX2)
+    {
+        for (; index + 8 <= count; index += 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            for (int tap = 0; tap < tapCount; ++tap)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(&rows[tap][index]), _mm256_set1_ps(weights[tap])));
+            _mm256_storeu_ps(&out[index], sum);
+        }
+    }
+
+    for (; index + 4 <= count; index += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int tap = 0; tap < tapCount; ++tap)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&rows[tap][index]), _mm_set1_ps(weights[tap])));
+        _mm_storeu_ps(&out[index], sum);
+    }
+
+    for (; index < count; ++index)
+    {
+        float sum = 0.0f;
+        for (int tap = 0; tap < tapCount; ++tap)
+            sum += rows[tap][index] * weights[tap];
+        out[index] = sum;
+    }
+}
+
+// The horizontal pass, with the 3 channels of a pixel (and one float of padding) in 4 lanes. AVX2 does two
+// dest pixels at once, one in each half. Storing 4 floats writes the padding or the next pixel, which gets
+// written right after, so src and dest both need a pixel of padding.
+inline void FilterRow(const RGBF32* src, const FilterTaps& taps, RGBF32* dest, int destWidth)
+{
+    int x = 0;
+    if (GetSIMDLevel() >= SIMDLevel::AVX2)
+    {
+        for (; x + 2 <= destWidth; x += 2)
+        {
+            const int* indices = &taps.sourceIndex[x * taps.tapCount];
+            const float* weights = &taps.weight[x * taps.tapCount];
+
+            __m256 sum = _mm256_setzero_ps();
+            for (int tap = 0; tap < taps.tapCount; ++tap)
+            {
+                __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&src[indices[tap]].r)), _mm_loadu_ps(&src[indices[taps.tapCount + tap]].r), 1);
+                __m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weights[tap])), _mm_set1_ps(weights[taps.tapCount + tap]), 1);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(texels, weight));
+            }
+
+            _mm_storeu_ps(&dest[x].r, _mm256_castps256_ps128(sum));
+            _mm_storeu_ps(&dest[x + 1].r, _mm256_extractf128_ps(sum, 1));
+        }
+    }
+
+    for (; x < destWidth; ++x)
+    {
+        const int* indices = &taps.sourceIndex[x * taps.tapCount];
+        const float* weights = &taps.weight[x * taps.tapCount];
+
+        __m128 sum = _mm_setzero_ps();
+        for (int tap = 0; tap < taps.tapCount; ++tap)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&src[indices[tap]].r), _mm_set1_ps(weights[tap])));
+        _mm_storeu_ps(&dest[x].r, sum);
+    }
+}
+
+// Makes rows [yBegin, yEnd) of dest from src.
+//
+// The vertical pass goes first, over whole source rows, and then one horizontal pass makes the dest row from
+// that. Doing the vertical pass on the wider rows costs less than doing the horizontal pass on every source
+// row, since the vertical pass is 8 floats per instruction instead of 4 or 8 floats per pixel.
+//
+// The decoded source rows are kept in a small cache, since neighboring dest rows share most of their source
+// rows. A slot is only reused when it isn't needed by the current dest row, so a cache with a couple more
+// slots than there are vertical taps always has room.
+template <typename TEXEL>
+inline void FilterMipRows(const ImageT<TEXEL>& src, ImageT<TEXEL>& dest, const FilterTaps& tapsX, const FilterTaps& tapsY, int yBegin, int yEnd, const ColorTables& colorTables)
+{
+    // the SIMD loads and stores of a pixel touch one float past it, so rows are padded by a pixel
+    std::vector<RGBF32> columnRow(src.width + 1);
+    std::vector<RGBF32> outRow(dest.width + 1);
+
+    int slotCount = tapsY.tapCount + 2;
+    std::vector<RGBF32> slots(slotCount * src.width);
+    std::vector<int> slotRow(slotCount, -1);
+    std::vector<int> slotLastUsed(slotCount, -1);
+    std::vector<const float*> rowTaps(tapsY.tapCount);
+
+    for (int y = yBegin; y < yEnd; ++y)
+    {
+        const int* rowIndices = &tapsY.sourceIndex[y * tapsY.tapCount];
+        const float* rowWeights = &tapsY.weight[y * tapsY.tapCount];
+
+        for (int tap = 0; tap < tapsY.tapCount; ++tap)
+        {
+            int row = rowIndices[tap];
+
+            int slot = int(std::find(slotRow.begin(), slotRow.end(), row) - slotRow.begin());
+            if (slot == slotCount)
+            {
+                // evict the least recently used slot, which can't be one this dest row has used
+                slot = int(std::min_element(slotLastUsed.begin(), slotLastUsed.end()) - slotLastUsed.begin());
+                slotRow[slot] = row;
+                LoadLinearRow(&src.pixels[row * src.width], &slots[slot * src.width], src.width, colorTables);
+            }
+            slotLastUsed[slot] = y;
+            rowTaps[tap] = &slots[slot * src.width].r;
+        }
+
+        FilterColumns(rowTaps.data(), rowWeights, tapsY.tapCount, &columnRow[0].r, src.width * 3);
+        FilterRow(columnRow.data(), tapsX, outRow.data(), dest.width);
+        StoreLinearRow(outRow.data(), &dest.pixels[y * dest.width], dest.width, colorTables);
+    }
+}
+
+// Make mips of an image using the given filter. Works with any of the texel formats.
+template <typename TEXEL>
+inline void MakeMipsFiltered(ImageMipsT<TEXEL>& mips, const uint8* pixels, int width, int height, MipFilter filter, ColorCurve curve = ColorCurve::Gamma22, ThreadPool& threadPool = GetThreadPool())
+{
+    const ColorTables& colorTables = GetColorTables(curve);
+
+    mips.Allocate(width, height);
+    int numMips = int(mips.size());
+    int bandDivisor = threadPool.ThreadCount() * 4;
+
+    // convert the full sized image into the first mip
+    ConvertSourcePixels((const RGBU8*)pixels, mips[0].pixels.data(), width * height, colorTables);
+
+    // make the rest of the mips
+    for (int mipIndex = 1; mipIndex < numMips; ++mipIndex)
+    {
+        const ImageT<TEXEL>& src = mips[mipIndex - 1];
+        ImageT<TEXEL>& dest = mips[mipIndex];
+
+        FilterTaps tapsX = MakeFilterTaps(filter, src.width, dest.width);
+        FilterTaps tapsY = MakeFilterTaps(filter, src.height, dest.height);
+
+        threadPool.ParallelFor(dest.height, std::max(dest.height / bandDivisor, 1),
+            [&](int yBegin, int yEnd)
+            {
+                FilterMipRows(src, dest, tapsX, tapsY, yBegin, yEnd, colorTables);
+            }
+        );
+    }
+}
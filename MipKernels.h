@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ColorConversion.h"
+#include "CPUFeatures.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// SIMD kernels for the common case of making a mip pixel from a 2x2 block of RGBU8 source pixels.
+//
+// The kernels treat a row as a run of bytes rather than pixels. Dest byte j is channel j%3 of pixel j/3,
+// which comes from source bytes 2j - j%3 and 2j - j%3 + 3 of each of the two source rows. That way RGB
+// doesn't need to be de-interleaved into separate channels, and the pattern of source offsets repeats
+// every 3 dest bytes.
+//
+// The sum of the 4 decoded values is done in the same order as the scalar code, so the results match it
+// exactly.
+//
+// Each kernel does as many of the destWidth dest pixels as it can without reading past the end of the
+// srcWidth source pixels, and returns how many it did. The caller does the rest with scalar code.
+
+// 4 dest pixels (12 dest bytes, 3 vectors of 4) per iteration.
+inline int DownsampleBox2x2Row_SSE41(const uint8* srcRow0, const uint8* srcRow1, uint8* destRow, int destWidth, int srcWidth, const ColorTables& tables)
+{
+    // The 27 source bytes an iteration reads are loaded as two 16 byte halves. These are the shuffles that
+    // move the left and right source byte for each dest byte into the bottom of a 32 bit lane, from each half.
+    struct ShuffleMasks
+    {
+        ShuffleMasks()
+        {
+            for (int vector = 0; vector < 3; ++vector)
+            {
+                for (int tap = 0; tap < 2; ++tap)
+                {
+                    uint8 lowBytes[16], highBytes[16];
+                    memset(lowBytes, 0x80, 16);
+                    memset(highBytes, 0x80, 16);
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        int j = vector * 4 + lane;
+                        int offset = 2 * j - j % 3 + tap * 3;
+                        if (offset < 16)
+                            lowBytes[lane * 4] = uint8(offset);
+                        else
+                            highBytes[lane * 4] = uint8(offset - 16);
+                    }
+                    low[vector][tap] = _mm_loadu_si128((const __m128i*)lowBytes);
+                    high[vector][tap] = _mm_loadu_si128((const __m128i*)highBytes);
+                }
+            }
+        }
+
+        __m128i low[3][2];
+        __m128i high[3][2];
+    };
+    static const ShuffleMasks s_masks;
+
+    const __m128 quarter = _mm_set1_ps(0.25f);
+
+    int x = 0;
+    for (; x + 4 <= destWidth && (x + 4) * 6 + 8 <= srcWidth * 3; x += 4)
+    {
+        __m128i row0Low = _mm_loadu_si128((const __m128i*)&srcRow0[x * 6]);
+        __m128i row0High = _mm_loadu_si128((const __m128i*)&srcRow0[x * 6 + 16]);
+        __m128i row1Low = _mm_loadu_si128((const __m128i*)&srcRow1[x * 6]);
+        __m128i row1High = _mm_loadu_si128((const __m128i*)&srcRow1[x * 6 + 16]);
+
+        for (int vector = 0; vector < 3; ++vector)
+        {
+            __m128i indices[4];
+            indices[0] = _mm_or_si128(_mm_shuffle_epi8(row0Low, s_masks.low[vector][0]), _mm_shuffle_epi8(row0High, s_masks.high[vector][0]));
+            indices[1] = _mm_or_si128(_mm_shuffle_epi8(row0Low, s_masks.low[vector][1]), _mm_shuffle_epi8(row0High, s_masks.high[vector][1]));
+            indices[2] = _mm_or_si128(_mm_shuffle_epi8(row1Low, s_masks.low[vector][0]), _mm_shuffle_epi8(row1High, s_masks.high[vector][0]));
+            indices[3] = _mm_or_si128(_mm_shuffle_epi8(row1Low, s_masks.low[vector][1]), _mm_shuffle_epi8(row1High, s_masks.high[vector][1]));
+
+            // no gather in SSE, so the decode table is read per lane
+            __m128 sum = _mm_setzero_ps();
+            for (int tap = 0; tap < 4; ++tap)
+            {
+                __m128 decoded = _mm_setr_ps(
+                    tables.decode[_mm_extract_epi32(indices[tap], 0)],
+                    tables.decode[_mm_extract_epi32(indices[tap], 1)],
+                    tables.decode[_mm_extract_epi32(indices[tap], 2)],
+                    tables.decode[_mm_extract_epi32(indices[tap], 3)]
+                );
+                sum = _mm_add_ps(sum, decoded);
+            }
+
+            __m128i encoded = EncodeFromLinear4(tables, _mm_mul_ps(sum, quarter));
+            encoded = _mm_packus_epi16(_mm_packs_epi32(encoded, encoded), encoded);
+            int packed = _mm_cvtsi128_si32(encoded);
+            memcpy(&destRow[x * 3 + vector * 4], &packed, 4);
+        }
+    }
+    return x;
+}
+
+// 8 dest pixels (24 dest bytes, 3 vectors of 8) per iteration.
+inline int DownsampleBox2x2Row_AVX2(const uint8* srcRow0, const uint8* srcRow1, uint8* destRow, int destWidth, int srcWidth, const ColorTables& tables)
+{
+    // A 32 bit gather at the left source byte of a dest byte gets the right source byte in its top byte.
+    const __m256i offsets[3] =
+    {
+        _mm256_setr_epi32(0, 1, 2, 6, 7, 8, 12, 13),
+        _mm256_setr_epi32(14, 18, 19, 20, 24, 25, 26, 30),
+        _mm256_setr_epi32(31, 32, 36, 37, 38, 42, 43, 44),
+    };
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+
+    int x = 0;
+    for (; x + 8 <= destWidth && (x + 8) * 6 + 3 <= srcWidth * 3; x += 8)
+    {
+        const int* row0 = (const int*)&srcRow0[x * 6];
+        const int* row1 = (const int*)&srcRow1[x * 6];
+
+        for (int vector = 0; vector < 3; ++vector)
+        {
+            __m256i taps0 = _mm256_i32gather_epi32(row0, offsets[vector], 1);
+            __m256i taps1 = _mm256_i32gather_epi32(row1, offsets[vector], 1);
+
+            __m256 sum = _mm256_i32gather_ps(tables.decode, _mm256_and_si256(taps0, byteMask), 4);
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(tables.decode, _mm256_srli_epi32(taps0, 24), 4));
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(tables.decode, _mm256_and_si256(taps1, byteMask), 4));
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(tables.decode, _mm256_srli_epi32(taps1, 24), 4));
+
+            __m256i encoded = EncodeFromLinear8(tables, _mm256_mul_ps(sum, quarter));
+            encoded = _mm256_packus_epi16(_mm256_packs_epi32(encoded, encoded), encoded);
+            int packedLow = _mm_cvtsi128_si32(_mm256_castsi256_si128(encoded));
+            int packedHigh = _mm_cvtsi128_si32(_mm256_extracti128_si256(encoded, 1));
+            memcpy(&destRow[x * 3 + vector * 8], &packedLow, 4);
+            memcpy(&destRow[x * 3 + vector * 8 + 4], &packedHigh, 4);
+        }
+    }
+    return x;
+}
+
+inline int DownsampleBox2x2Row(const uint8* srcRow0, const uint8* srcRow1, uint8* destRow, int destWidth, int srcWidth, const ColorTables& tables, SIMDLevel simdLevel = GetSIMDLevel())
+{
+    switch (simdLevel)
+    {
+        case SIMDLevel::AVX2: return DownsampleBox2x2Row_AVX2(srcRow0, srcRow1, destRow, destWidth, srcWidth, tables);
+        case SIMDLevel::SSE41: return DownsampleBox2x2Row_SSE41(srcRow0, srcRow1, destRow, destWidth, srcWidth, tables);
+        default: return 0;
+    }
+}
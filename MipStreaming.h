@@ -0,0 +1,222 @@
+#pragma once
+
+#include "MipCache.h"
+#include "Mips.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Makes mips for images too big to hold in memory, like a 64K x 64K scan.
+//
+// The source image is given a strip of rows at a time, in order from the top. Each mip keeps only the few
+// rows of the mip above it that go into its next row, so every mip gets made as the strips go by, and rows
+// are written out to the file as soon as they are made. Memory use is a few rows per mip plus a small write
+// buffer per mip, no matter how big the image is.
+//
+// The file written is a mip cache file (see MipCache.h), so it can be memory mapped with LoadMipCache(). The
+// mips are made with the same box filter as MakeMips and come out exactly the same.
+class StreamingMipBuilder
+{
+public:
+    // how many bytes of finished rows each mip holds on to before writing them out
+    static const size_t c_writeBufferSize = 256 * 1024;
+
+    StreamingMipBuilder() = default;
+    StreamingMipBuilder(const StreamingMipBuilder&) = delete;
+    StreamingMipBuilder& operator = (const StreamingMipBuilder&) = delete;
+
+    ~StreamingMipBuilder()
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            remove(m_fileName.c_str());
+        }
+    }
+
+    // Creates the file and writes the header. The key is stored in the header the same way SaveMipCache()
+    // does it.
+    bool Begin(const char* fileName, int width, int height, uint64 key, ColorCurve curve = ColorCurve::Gamma22)
+    {
+        m_colorTables = &GetColorTables(curve);
+        m_layout.SetupLayoutsOnly(width, height);
+        m_dataOffset = MipCacheDataOffset(m_layout);
+        m_fileName = fileName;
+        m_ok = true;
+
+        m_levels.clear();
+        m_levels.resize(m_layout.size());
+        for (size_t mipIndex = 1; mipIndex < m_levels.size(); ++mipIndex)
+        {
+            LevelState& level = m_levels[mipIndex];
+            level.heightRatio = m_layout[mipIndex - 1].height / m_layout[mipIndex].height;
+            level.srcRows.resize(size_t(level.heightRatio) * m_layout[mipIndex - 1].width);
+            level.destRow.resize(m_layout[mipIndex].width);
+        }
+
+        m_file = fopen(fileName, "wb");
+        if (!m_file)
+            return false;
+
+        m_ok = WriteMipCacheHeader(m_file, m_layout, key);
+        return m_ok;
+    }
+
+    // Adds the next rows of the source image. The strips can be any number of rows, and don't need to be
+    // the same size each time. Rows past the bottom of the image are ignored.
+    bool AddRows(const uint8* pixels, int rowCount)
+    {
+        if (!m_file || !m_ok)
+            return false;
+
+        const Image& mip0 = m_layout[0];
+        rowCount = std::min(rowCount, mip0.height - m_levels[0].rowsDone);
+        if (rowCount <= 0)
+            return false;
+
+        // mip 0 rows are already in their final form, so the whole strip can go straight out
+        size_t rowPitch = m_layout.Layout(0).rowPitch;
+        const RGBU8* rows = (const RGBU8*)pixels;
+        m_ok = m_ok && WriteAt(m_layout.Layout(0).offset + m_levels[0].rowsDone * rowPitch, pixels, rowCount * rowPitch);
+        m_levels[0].rowsDone += rowCount;
+
+        for (int rowIndex = 0; rowIndex < rowCount && m_ok; ++rowIndex)
+            FeedRow(1, &rows[size_t(rowIndex) * mip0.width]);
+
+        return m_ok;
+    }
+
+    // Writes out whatever is still buffered and closes the file. Returns false if writing failed at any point,
+    // or if not all of the source rows were given, in which case the file is removed.
+    bool Finish()
+    {
+        if (!m_file)
+            return false;
+
+        for (size_t mipIndex = 1; mipIndex < m_levels.size(); ++mipIndex)
+        {
+            FlushLevel(int(mipIndex));
+            m_ok = m_ok && m_levels[mipIndex].rowsDone == m_layout[mipIndex].height;
+        }
+        m_ok = m_ok && m_levels[0].rowsDone == m_layout[0].height;
+
+        // the padding after the last mip never gets written otherwise, and the file needs to be full size
+        size_t lastMip = m_layout.size() - 1;
+        uint64 end = m_layout.Layout(lastMip).offset + uint64(m_layout[lastMip].height) * m_layout.Layout(lastMip).rowPitch;
+        std::vector<uint8> padding(size_t(m_layout.DataSize() - end), 0);
+        m_ok = m_ok && (padding.empty() || WriteAt(end, padding.data(), padding.size()));
+
+        m_ok = (fclose(m_file) == 0) && m_ok;
+        m_file = nullptr;
+
+        if (!m_ok)
+            remove(m_fileName.c_str());
+        return m_ok;
+    }
+
+    // the sizes and layouts of the mips being written
+    const ImageMips& Layout() const { return m_layout; }
+
+    // The bytes held for rows of the mips, which is all the memory the builder uses besides the layout. The
+    // buffers only ever grow, so this is also the most it has held at once.
+    size_t BufferBytes() const
+    {
+        size_t ret = 0;
+        for (const LevelState& level : m_levels)
+            ret += (level.srcRows.capacity() + level.destRow.capacity() + level.writeBuffer.capacity()) * sizeof(RGBU8);
+        return ret;
+    }
+
+private:
+    struct LevelState
+    {
+        int heightRatio = 1;
+
+        // rows of the mip above that have been seen, and the last heightRatio of them
+        int srcRowsSeen = 0;
+        std::vector<RGBU8> srcRows;
+
+        // rows of this mip made so far, and the ones that haven't been written yet
+        int rowsDone = 0;
+        int rowsWritten = 0;
+        std::vector<RGBU8> destRow;
+        std::vector<RGBU8> writeBuffer;
+    };
+
+    // gives a finished row of mip (mipIndex - 1) to mipIndex, which makes a row of its own once it has enough
+    void FeedRow(int mipIndex, const RGBU8* row)
+    {
+        if (mipIndex >= int(m_levels.size()))
+            return;
+
+        LevelState& level = m_levels[mipIndex];
+        const Image& src = m_layout[mipIndex - 1];
+        const Image& dest = m_layout[mipIndex];
+
+        // like MakeMips, the last row of an odd sized mip doesn't go into the next one
+        int srcRow = level.srcRowsSeen++;
+        if (srcRow >= dest.height * level.heightRatio)
+            return;
+
+        int rowInBlock = srcRow % level.heightRatio;
+        memcpy(&level.srcRows[size_t(rowInBlock) * src.width], row, src.width * sizeof(RGBU8));
+        if (rowInBlock != level.heightRatio - 1)
+            return;
+
+        // DownsampleBoxRect works out the ratios from the image sizes, so these views give it the same
+        // mapping it uses when it has the whole mip
+        Image srcView;
+        srcView.width = src.width;
+        srcView.height = level.heightRatio;
+        srcView.pixels = PixelSpan<RGBU8>(level.srcRows.data(), level.srcRows.size());
+
+        Image destView;
+        destView.width = dest.width;
+        destView.height = 1;
+        destView.pixels = PixelSpan<RGBU8>(level.destRow.data(), level.destRow.size());
+
+        DownsampleBoxRows(srcView, destView, 0, 1, *m_colorTables);
+        level.rowsDone++;
+
+        level.writeBuffer.insert(level.writeBuffer.end(), level.destRow.begin(), level.destRow.end());
+        if (level.writeBuffer.size() * sizeof(RGBU8) >= c_writeBufferSize)
+            FlushLevel(mipIndex);
+
+        FeedRow(mipIndex + 1, level.destRow.data());
+    }
+
+    void FlushLevel(int mipIndex)
+    {
+        LevelState& level = m_levels[mipIndex];
+        if (level.writeBuffer.empty())
+            return;
+
+        uint64 offset = m_layout.Layout(mipIndex).offset + uint64(level.rowsWritten) * m_layout.Layout(mipIndex).rowPitch;
+        m_ok = m_ok && WriteAt(offset, level.writeBuffer.data(), level.writeBuffer.size() * sizeof(RGBU8));
+        level.rowsWritten = level.rowsDone;
+        level.writeBuffer.clear();
+    }
+
+    // writes to an offset in the mip storage. The offsets go past 4GB for big images.
+    bool WriteAt(uint64 offset, const void* data, size_t size)
+    {
+        offset += m_dataOffset;
+#ifdef _WIN32
+        if (_fseeki64(m_file, (long long)offset, SEEK_SET) != 0)
+            return false;
+#else
+        if (fseeko(m_file, (off_t)offset, SEEK_SET) != 0)
+            return false;
+#endif
+        return fwrite(data, size, 1, m_file) == 1;
+    }
+
+    ImageMips m_layout;
+    std::vector<LevelState> m_levels;
+    const ColorTables* m_colorTables = nullptr;
+    std::string m_fileName;
+    uint64 m_dataOffset = 0;
+    FILE* m_file = nullptr;
+    bool m_ok = false;
+};
@@ -0,0 +1,362 @@
+#pragma once
+
+#include "Images.h"
+#include "MipKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Makes the pixels of dest in [xBegin, xEnd) x [yBegin, yEnd) from src using a box filter. This is a common way
+// to make mips. dest is expected to be half the size of src on each axis, but never less than 1 pixel.
+inline void DownsampleBoxRect(const Image& src, Image& dest, int xBegin, int yBegin, int xEnd, int yEnd, const ColorTables& colorTables)
+{
+    int widthRatio = src.width / dest.width;
+    int heightRatio = src.height / dest.height;
+    int rectWidth = xEnd - xBegin;
+
+    const RGBU8* srcPixels = src.pixels.data();
+
+    // a row of linear colors, which gets encoded back to sRGB all at once
+    std::vector<RGBF32> linearRow(rectWidth);
+
+    for (int y = yBegin; y < yEnd; ++y)
+    {
+        RGBU8* destPixel = &dest.pixels[y * dest.width + xBegin];
+
+        // the common 2x2 case has SIMD kernels, which leave the pixels at the right edge to the scalar loop below
+        int simdWidth = 0;
+        if (widthRatio == 2 && heightRatio == 2)
+        {
+            const uint8* srcRow0 = &srcPixels[(y * 2) * src.width + xBegin * 2].r;
+            const uint8* srcRow1 = &srcPixels[(y * 2 + 1) * src.width + xBegin * 2].r;
+            simdWidth = DownsampleBox2x2Row(srcRow0, srcRow1, &destPixel[0].r, rectWidth, src.width - xBegin * 2, colorTables);
+        }
+
+        for (int x = xBegin + simdWidth; x < xEnd; ++x)
+        {
+            // Make a mip pixel by averaging the 4 contributing pixels of the source image, and do it in linera space, not sRGB
+            // Due to the std::max call, it may not be 4 pixels contributing though.
+            int sampleCount = 0;
+            RGBF32 linearColor;
+            for (int iy = 0; iy < heightRatio; ++iy)
+            {
+                for (int ix = 0; ix < widthRatio; ++ix)
+                {
+                    linearColor += RGB_U8_To_F32(srcPixels[(y * heightRatio + iy)*src.width + (x * widthRatio + ix)], colorTables);
+                    ++sampleCount;
+                }
+            }
+            linearColor *= 1.0f / float(sampleCount);
+            linearRow[x - xBegin] = linearColor;
+        }
+
+        // convert the row back to sRGB U8 and write it into the destination pixels
+        EncodeFromLinear(colorTables, &linearRow[simdWidth].r, &destPixel[simdWidth].r, (rectWidth - simdWidth) * 3);
+    }
+}
+
+// Makes rows [yBegin, yEnd) of dest from src using a box filter.
+inline void DownsampleBoxRows(const Image& src, Image& dest, int yBegin, int yEnd, const ColorTables& colorTables)
+{
+    DownsampleBoxRect(src, dest, 0, yBegin, dest.width, yEnd, colorTables);
+}
+
+// Make mips of an image, using a box filter.
+// The curve says how the U8 pixels are encoded, since the averaging needs to happen in linear space.
+// Rows of each mip are independent, so each mip is split into bands of rows which are made in parallel.
+inline void MakeMips(ImageMips& mips, const uint8* pixels, int width, int height, ColorCurve curve = ColorCurve::Gamma22, ThreadPool& threadPool = GetThreadPool())
+{
+    const ColorTables& colorTables = GetColorTables(curve);
+
+    // allocate memory for all of the mips, and copy the full sized image as the first mip
+    mips.Allocate(width, height);
+    int numMips = int(mips.size());
+    memcpy(mips[0].pixels.data(), pixels, width*height * sizeof(RGBU8));
+
+    // make the rest of the mips
+    for (int mipIndex = 1; mipIndex < numMips; ++mipIndex)
+    {
+        const Image& src = mips[mipIndex - 1];
+        Image& dest = mips[mipIndex];
+
+        // several bands per thread so that uneven progress between threads evens out
+        int bandSize = std::max(dest.height / (threadPool.ThreadCount() * 4), 1);
+        threadPool.ParallelFor(dest.height, bandSize,
+            [&](int yBegin, int yEnd)
+            {
+                DownsampleBoxRows(src, dest, yBegin, yEnd, colorTables);
+            }
+        );
+    }
+}
+
+// Makes rows [yBegin, yEnd) of dest from src using a box filter, for textures stored in a linear format.
+template <typename TEXEL>
+inline void DownsampleBoxRowsLinear(const ImageT<TEXEL>& src, ImageT<TEXEL>& dest, int yBegin, int yEnd, const ColorTables& colorTables)
+{
+    int widthRatio = src.width / dest.width;
+    int heightRatio = src.height / dest.height;
+    float scale = 1.0f / float(widthRatio * heightRatio);
+
+    for (int y = yBegin; y < yEnd; ++y)
+    {
+        for (int x = 0; x < dest.width; ++x)
+        {
+            RGBF32 linearColor;
+            for (int iy = 0; iy < heightRatio; ++iy)
+                for (int ix = 0; ix < widthRatio; ++ix)
+                    linearColor += TexelTraits<TEXEL>::ToLinear(src.pixels[(y * heightRatio + iy)*src.width + (x * widthRatio + ix)], colorTables);
+            linearColor *= scale;
+            dest.pixels[y * dest.width + x] = TexelTraits<TEXEL>::FromLinear(linearColor, colorTables);
+        }
+    }
+}
+
+// Make mips for a texture stored in a linear format (RGBF32 or RGBF16). The U8 source pixels are decoded
+// once, and after that there are no round trips through sRGB between mips.
+template <typename TEXEL>
+inline void MakeMips(ImageMipsT<TEXEL>& mips, const uint8* pixels, int width, int height, ColorCurve curve = ColorCurve::Gamma22, ThreadPool& threadPool = GetThreadPool())
+{
+    const ColorTables& colorTables = GetColorTables(curve);
+
+    mips.Allocate(width, height);
+    int numMips = int(mips.size());
+    int bandDivisor = threadPool.ThreadCount() * 4;
+
+    // decode the full sized image into the first mip
+    const RGBU8* srcPixels = (const RGBU8*)pixels;
+    threadPool.ParallelFor(height, std::max(height / bandDivisor, 1),
+        [&](int yBegin, int yEnd)
+        {
+            for (int index = yBegin * width; index < yEnd * width; ++index)
+                mips[0].pixels[index] = TexelTraits<TEXEL>::FromLinear(RGB_U8_To_F32(srcPixels[index], colorTables), colorTables);
+        }
+    );
+
+    // make the rest of the mips
+    for (int mipIndex = 1; mipIndex < numMips; ++mipIndex)
+    {
+        const ImageT<TEXEL>& src = mips[mipIndex - 1];
+        ImageT<TEXEL>& dest = mips[mipIndex];
+
+        threadPool.ParallelFor(dest.height, std::max(dest.height / bandDivisor, 1),
+            [&](int yBegin, int yEnd)
+            {
+                DownsampleBoxRowsLinear(src, dest, yBegin, yEnd, colorTables);
+            }
+        );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Single pass mip generation.
+//
+// MakeMips reads each mip back from memory to make the next one, and decodes it from the U8 data it just
+// encoded. This instead loads a tile of mip 0 once and makes every mip that tile covers while the data is
+// still in cache, keeping the intermediate results as linear floats. When the tiles have made as many mips
+// as they can, the last few (tiny) mips are made from the linear floats of the last tiled mip.
+//
+// Since nothing gets quantized between mips, the results are more accurate than MakeMips and can differ
+// from it by a small amount.
+
+static const int c_singlePassTileSize = 64;
+
+// how many source pixels go into a mip pixel along an axis. This is 2, except for sizes 1 and 3.
+inline int MipRatio(int srcSize)
+{
+    return srcSize / std::max(srcSize / 2, 1);
+}
+
+// averages blocks of widthRatio x heightRatio linear colors. Strides are in pixels.
+inline void DownsampleBoxLinear(const RGBF32* src, int srcStride, RGBF32* dest, int destStride, int destWidth, int destHeight, int widthRatio, int heightRatio)
+{
+    float scale = 1.0f / float(widthRatio * heightRatio);
+    for (int y = 0; y < destHeight; ++y)
+    {
+        for (int x = 0; x < destWidth; ++x)
+        {
+            RGBF32 linearColor;
+            for (int iy = 0; iy < heightRatio; ++iy)
+                for (int ix = 0; ix < widthRatio; ++ix)
+                    linearColor += src[(y * heightRatio + iy) * srcStride + x * widthRatio + ix];
+            linearColor *= scale;
+            dest[y * destStride + x] = linearColor;
+        }
+    }
+}
+
+// Averages 2x2 blocks of linear colors from two rows, with the 3 channels of a pixel (and one float of the
+// next pixel) in one register. The sums are done in the same order as DownsampleBoxLinear() and the scalar
+// loop of DownsampleBoxRect(), so the results are exactly the same. Both source rows are read one float past
+// their last pixel, and dest is written one float past its last pixel.
+inline void DownsampleBox2x2LinearRow(const RGBF32* srcRow0, const RGBF32* srcRow1, RGBF32* dest, int destWidth)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (int x = 0; x < destWidth; ++x)
+    {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(&srcRow0[x * 2].r), _mm_loadu_ps(&srcRow0[x * 2 + 1].r));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(&srcRow1[x * 2].r));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(&srcRow1[x * 2 + 1].r));
+        _mm_storeu_ps(&dest[x].r, _mm_mul_ps(sum, quarter));
+    }
+}
+
+// writes a rectangle of linear colors into a mip, encoding it to U8 a row at a time
+inline void EncodeLinearRect(const RGBF32* src, int srcStride, Image& dest, int destX, int destY, int width, int height, const ColorTables& colorTables)
+{
+    for (int y = 0; y < height; ++y)
+        EncodeFromLinear(colorTables, &src[y * srcStride].r, &dest.pixels[(destY + y) * dest.width + destX].r, width * 3);
+}
+
+inline void MakeMipsSinglePass(ImageMips& mips, const uint8* pixels, int width, int height, ColorCurve curve = ColorCurve::Gamma22, ThreadPool& threadPool = GetThreadPool())
+{
+    const ColorTables& colorTables = GetColorTables(curve);
+
+    // allocate memory for all of the mips, and copy the full sized image as the first mip
+    mips.Allocate(width, height);
+    int numMips = int(mips.size());
+    memcpy(mips[0].pixels.data(), pixels, width*height * sizeof(RGBU8));
+
+    // The tiles can make a mip as long as each of its pixels comes from a single tile. That stops being true
+    // when the tile shrinks to one pixel, or when an axis has a size of 3 since that squashes 3 pixels into 1.
+    int tileMipCount = 0;
+    while (tileMipCount + 1 < numMips &&
+           (c_singlePassTileSize >> (tileMipCount + 1)) >= 1 &&
+           MipRatio(mips[tileMipCount].width) <= 2 &&
+           MipRatio(mips[tileMipCount].height) <= 2)
+    {
+        tileMipCount++;
+    }
+
+    // the last tiled mip is also kept in linear to make the rest of the mips from
+    int linearWidth = mips[tileMipCount].width;
+    int linearHeight = mips[tileMipCount].height;
+    std::vector<RGBF32> linearMip(linearWidth * linearHeight);
+
+    if (tileMipCount == 0)
+    {
+        for (size_t index = 0; index < linearMip.size(); ++index)
+            linearMip[index] = RGB_U8_To_F32(mips[0].pixels[index], colorTables);
+    }
+    else
+    {
+        int tilesX = (width + c_singlePassTileSize - 1) / c_singlePassTileSize;
+        int tilesY = (height + c_singlePassTileSize - 1) / c_singlePassTileSize;
+
+        threadPool.ParallelFor(tilesX * tilesY, 1,
+            [&](int tileBegin, int tileEnd)
+            {
+                // Ping pong between two buffers, each big enough for mip 1 of a tile, plus the two decoded source
+                // rows that go into a row of mip 1. Each has a float of padding for the SIMD loads and stores.
+                const int c_halfTile = c_singlePassTileSize / 2;
+                std::vector<RGBF32> buffers[2];
+                buffers[0].resize(c_halfTile * c_halfTile + 1);
+                buffers[1].resize(c_halfTile * c_halfTile + 1);
+                std::vector<RGBF32> decodedRows[2];
+                decodedRows[0].resize(c_singlePassTileSize + 1);
+                decodedRows[1].resize(c_singlePassTileSize + 1);
+
+                for (int tileIndex = tileBegin; tileIndex < tileEnd; ++tileIndex)
+                {
+                    // the region of the previous mip that this tile covers
+                    int beginX = (tileIndex % tilesX) * c_singlePassTileSize;
+                    int beginY = (tileIndex / tilesX) * c_singlePassTileSize;
+                    int endX = std::min(beginX + c_singlePassTileSize, width);
+                    int endY = std::min(beginY + c_singlePassTileSize, height);
+
+                    for (int mipIndex = 1; mipIndex <= tileMipCount; ++mipIndex)
+                    {
+                        const Image& src = mips[mipIndex - 1];
+                        Image& dest = mips[mipIndex];
+                        int widthRatio = MipRatio(src.width);
+                        int heightRatio = MipRatio(src.height);
+
+                        // an odd sized edge drops the last row or column, same as MakeMips
+                        int srcStride = endX - beginX;
+                        int destBeginX = beginX / widthRatio;
+                        int destBeginY = beginY / heightRatio;
+                        int destEndX = std::min(endX / widthRatio, dest.width);
+                        int destEndY = std::min(endY / heightRatio, dest.height);
+                        if (destBeginX >= destEndX || destBeginY >= destEndY)
+                            break;
+
+                        int destWidth = destEndX - destBeginX;
+                        int destHeight = destEndY - destBeginY;
+                        RGBF32* destLinear = buffers[mipIndex % 2].data();
+                        bool box2x2 = (widthRatio == 2 && heightRatio == 2);
+
+                        if (mipIndex == 1 && box2x2)
+                        {
+                            // the first mip comes from the U8 source, decoded a row at a time through the table
+                            for (int y = 0; y < destHeight; ++y)
+                            {
+                                for (int row = 0; row < 2; ++row)
+                                {
+                                    const RGBU8* srcPixels = &src.pixels[(beginY + y * 2 + row) * src.width + beginX];
+                                    DecodeToLinear(colorTables, &srcPixels[0].r, &decodedRows[row][0].r, destWidth * 2 * 3);
+                                }
+                                DownsampleBox2x2LinearRow(decodedRows[0].data(), decodedRows[1].data(), &destLinear[y * destWidth], destWidth);
+                            }
+                        }
+                        else if (mipIndex == 1)
+                        {
+                            // a mip 0 that's 1 pixel on an axis
+                            float scale = 1.0f / float(widthRatio * heightRatio);
+                            for (int y = 0; y < destHeight; ++y)
+                            {
+                                for (int x = 0; x < destWidth; ++x)
+                                {
+                                    RGBF32 linearColor;
+                                    for (int iy = 0; iy < heightRatio; ++iy)
+                                        for (int ix = 0; ix < widthRatio; ++ix)
+                                            linearColor += RGB_U8_To_F32(src.pixels[(beginY + y * heightRatio + iy) * src.width + beginX + x * widthRatio + ix], colorTables);
+                                    linearColor *= scale;
+                                    destLinear[y * destWidth + x] = linearColor;
+                                }
+                            }
+                        }
+                        else if (box2x2)
+                        {
+                            const RGBF32* srcLinear = buffers[(mipIndex - 1) % 2].data();
+                            for (int y = 0; y < destHeight; ++y)
+                                DownsampleBox2x2LinearRow(&srcLinear[(y * 2) * srcStride], &srcLinear[(y * 2 + 1) * srcStride], &destLinear[y * destWidth], destWidth);
+                        }
+                        else
+                        {
+                            const RGBF32* srcLinear = buffers[(mipIndex - 1) % 2].data();
+                            DownsampleBoxLinear(srcLinear, srcStride, destLinear, destWidth, destWidth, destHeight, widthRatio, heightRatio);
+                        }
+
+                        EncodeLinearRect(destLinear, destWidth, dest, destBeginX, destBeginY, destWidth, destHeight, colorTables);
+
+                        if (mipIndex == tileMipCount)
+                        {
+                            for (int y = 0; y < destHeight; ++y)
+                                memcpy(&linearMip[(destBeginY + y) * linearWidth + destBeginX], &destLinear[y * destWidth], destWidth * sizeof(RGBF32));
+                        }
+
+                        beginX = destBeginX;
+                        beginY = destBeginY;
+                        endX = destEndX;
+                        endY = destEndY;
+                    }
+                }
+            }
+        );
+    }
+
+    // make the remaining mips from the linear version of the last tiled mip
+    std::vector<RGBF32> nextLinearMip;
+    for (int mipIndex = tileMipCount + 1; mipIndex < numMips; ++mipIndex)
+    {
+        Image& dest = mips[mipIndex];
+        nextLinearMip.resize(dest.width * dest.height);
+        DownsampleBoxLinear(linearMip.data(), linearWidth, nextLinearMip.data(), dest.width, dest.width, dest.height, MipRatio(linearWidth), MipRatio(linearHeight));
+        EncodeLinearRect(nextLinearMip.data(), dest.width, dest, 0, 0, dest.width, dest.height, colorTables);
+
+        std::swap(linearMip, nextLinearMip);
+        linearWidth = dest.width;
+        linearHeight = dest.height;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "BatchSampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+#include <vector>
+
+// Rendering a 2x2 quad of pixels at a time, the way GPUs run pixel shaders, for mappings from pixels to uvs
+// that aren't affine, like perspective or any warp. With an affine mapping one mip fits the whole image, but
+// otherwise the footprint of a pixel changes across the image, and the mip has to be picked locally.
+//
+// The uvs of the 4 pixels of a quad are held in one SIMD register each for u and v, with the lanes in the
+// order (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1). The derivatives come from finite differences between
+// the lanes, like ddx and ddy on a GPU: d_uv_dx from the top two pixels and d_uv_dy from the left two. Like
+// coarse derivatives on a GPU, all 4 pixels share them and so get the same mip.
+//
+// Quads on the right or bottom edge of an odd sized image still work out all 4 uvs, so the derivatives are
+// there, but only the pixels inside the image get written.
+//
+// The mapping is either a projective Matrix33, where [x, y, 1] * matrix is divided by its third component,
+// or any function taking the pixel's position as a Vector2 percent (like TestMipMatrix uses) and returning
+// its uv. The matrix is done 4 pixels at a time in SIMD, and the function is called once per pixel.
+
+struct QuadUV4
+{
+    __m128 u;
+    __m128 v;
+};
+
+// the percents of the pixel centers of the quad at (x, y), the same as PixelToUV() gives
+inline void QuadPercents4(int x, int y, int width, int height, __m128& percentX, __m128& percentY)
+{
+    __m128 pixelX = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.5f, 1.5f, 0.5f, 1.5f));
+    __m128 pixelY = _mm_add_ps(_mm_set1_ps(float(y)), _mm_setr_ps(0.5f, 0.5f, 1.5f, 1.5f));
+    percentX = _mm_div_ps(pixelX, _mm_set1_ps(float(width)));
+    percentY = _mm_div_ps(pixelY, _mm_set1_ps(float(height)));
+}
+
+inline QuadUV4 MapQuad4(const Matrix33& mapping, __m128 percentX, __m128 percentY)
+{
+    __m128 uvw[3];
+    for (int column = 0; column < 3; ++column)
+    {
+        uvw[column] = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(percentX, _mm_set1_ps(mapping[0][column])),
+            _mm_mul_ps(percentY, _mm_set1_ps(mapping[1][column]))),
+            _mm_set1_ps(mapping[2][column]));
+    }
+
+    __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), uvw[2]);
+    return QuadUV4{ _mm_mul_ps(uvw[0], invW), _mm_mul_ps(uvw[1], invW) };
+}
+
+template <typename UVFN>
+inline QuadUV4 MapQuad4(const UVFN& mapping, __m128 percentX, __m128 percentY)
+{
+    alignas(16) float x[4];
+    alignas(16) float y[4];
+    alignas(16) float u[4];
+    alignas(16) float v[4];
+    _mm_store_ps(x, percentX);
+    _mm_store_ps(y, percentY);
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        Vector2 uv = mapping(Vector2{ x[lane], y[lane] });
+        u[lane] = uv[0];
+        v[lane] = uv[1];
+    }
+    return QuadUV4{ _mm_load_ps(u), _mm_load_ps(v) };
+}
+
+// The mip for a quad, from the longer of its two derivatives measured in texels of mip 0, the same way
+// CalculateMip() does it for a whole image.
+inline float QuadMip(const QuadUV4& uv, float textureWidth, float textureHeight, int mipCount)
+{
+    // (u0, v0, u1, v1) and (u2, v2, u3, v3)
+    __m128 top = _mm_unpacklo_ps(uv.u, uv.v);
+    __m128 bottom = _mm_unpackhi_ps(uv.u, uv.v);
+
+    // (du/dx, dv/dx, du/dy, dv/dy) from (u1, v1, u2, v2) - (u0, v0, u0, v0), then scaled to texels
+    __m128 derivatives = _mm_sub_ps(_mm_shuffle_ps(top, bottom, _MM_SHUFFLE(1, 0, 3, 2)), _mm_movelh_ps(top, top));
+    derivatives = _mm_mul_ps(derivatives, _mm_setr_ps(textureWidth, textureHeight, textureWidth, textureHeight));
+
+    // (lenx^2, leny^2) in the low two lanes
+    __m128 squared = _mm_mul_ps(derivatives, derivatives);
+    __m128 lengthsSquared = _mm_add_ps(_mm_shuffle_ps(squared, squared, _MM_SHUFFLE(3, 3, 2, 0)), _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(3, 3, 3, 1)));
+    float maxLengthSquared = _mm_cvtss_f32(_mm_max_ss(lengthsSquared, _mm_shuffle_ps(lengthsSquared, lengthsSquared, _MM_SHUFFLE(3, 3, 3, 1))));
+
+    // log2 of the length is half of log2 of the squared length, which saves a square root
+    return clamp(0.5f * std::log2f(std::max(maxLengthSquared, 1e-12f)), 0.0f, float(mipCount - 1));
+}
+
+// The uvs and mips of two rows of pixels, worked out a quad at a time, ready to be handed to the batch
+// samplers. Index 0 is the top row and 1 is the bottom row.
+struct QuadRows
+{
+    std::vector<float> u[2];
+    std::vector<float> v[2];
+    std::vector<float> mip[2];
+    std::vector<int> mipIndex[2];
+
+    // how many of the two rows are inside of the image
+    int rowCount = 0;
+};
+
+// Works out rows y and y + 1 of the image. y is expected to be even.
+template <typename MAPPING, typename TEXEL>
+inline void MakeQuadRows(const ImageMipsT<TEXEL>& texture, const MAPPING& mapping, int width, int height, int y, QuadRows& rows)
+{
+    // padded out to a whole number of quads, so the quads on the right edge can write all 4 of their pixels
+    int paddedWidth = (width + 1) & ~1;
+    for (int row = 0; row < 2; ++row)
+    {
+        rows.u[row].resize(paddedWidth);
+        rows.v[row].resize(paddedWidth);
+        rows.mip[row].resize(paddedWidth);
+        rows.mipIndex[row].resize(paddedWidth);
+    }
+    rows.rowCount = std::min(height - y, 2);
+
+    float textureWidth = float(texture[0].width);
+    float textureHeight = float(texture[0].height);
+    int mipCount = int(texture.size());
+
+    for (int x = 0; x < width; x += 2)
+    {
+        __m128 percentX, percentY;
+        QuadPercents4(x, y, width, height, percentX, percentY);
+        QuadUV4 uv = MapQuad4(mapping, percentX, percentY);
+        float mip = QuadMip(uv, textureWidth, textureHeight, mipCount);
+
+        // lanes 0 and 1 go to the top row, and 2 and 3 to the bottom row
+        _mm_storel_pi((__m64*)&rows.u[0][x], uv.u);
+        _mm_storel_pi((__m64*)&rows.v[0][x], uv.v);
+        _mm_storeh_pi((__m64*)&rows.u[1][x], uv.u);
+        _mm_storeh_pi((__m64*)&rows.v[1][x], uv.v);
+
+        for (int row = 0; row < 2; ++row)
+        {
+            rows.mip[row][x] = rows.mip[row][x + 1] = mip;
+            rows.mipIndex[row][x] = rows.mipIndex[row][x + 1] = int(mip);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Mips.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Ripmaps: every combination of halving the width some number of times and the height some other number of
+// times, so a footprint that is long on one axis and short on the other gets a level that fits it, instead of
+// the mip that fits the long axis. Level (x, y) is the image halved x times across and y times down. The
+// levels where x and y are the same are the usual mips.
+//
+// All of the levels live in one allocation, found through an index table, but a full ripmap is around 4x the
+// size of the texture and most views only use a few levels. So levels are made the first time a sampler
+// reads from them, and the pages of levels that never get made are never touched.
+//
+// Levels are made with the box filter of MakeMips. Level (x, y) is made from level (x - 1, y - 1) by halving
+// both axes, and the levels along the edges of the table are made by halving just one axis of the level
+// before them, with the filter leaving the other axis alone. That makes the levels on the diagonal exactly
+// the same as the mips MakeMips makes.
+//
+// Levels are safe to make from many threads at once, the same way tiles of LazyImageMips are.
+class RipMaps
+{
+public:
+    RipMaps(const uint8* pixels, int width, int height, ColorCurve curve = ColorCurve::Gamma22)
+        : m_colorTables(GetColorTables(curve))
+    {
+        m_levelsX = CalculateMipCount(width, 1);
+        m_levelsY = CalculateMipCount(1, height);
+
+        // the index table, with the sizes of each level and where it goes in the storage
+        std::vector<int> widths(m_levelsX);
+        std::vector<int> heights(m_levelsY);
+        for (int levelX = 0; levelX < m_levelsX; ++levelX)
+            widths[levelX] = (levelX == 0) ? width : std::max(widths[levelX - 1] / 2, 1);
+        for (int levelY = 0; levelY < m_levelsY; ++levelY)
+            heights[levelY] = (levelY == 0) ? height : std::max(heights[levelY - 1] / 2, 1);
+
+        m_levels.resize(size_t(m_levelsX) * m_levelsY);
+        m_layouts.resize(m_levels.size());
+        size_t storageSize = 0;
+        for (int levelY = 0; levelY < m_levelsY; ++levelY)
+        {
+            for (int levelX = 0; levelX < m_levelsX; ++levelX)
+            {
+                size_t levelIndex = LevelIndex(levelX, levelY);
+                m_levels[levelIndex].width = widths[levelX];
+                m_levels[levelIndex].height = heights[levelY];
+                m_layouts[levelIndex].offset = storageSize;
+                m_layouts[levelIndex].rowPitch = widths[levelX] * sizeof(RGBU8);
+                storageSize += ImageMips::AlignUp(heights[levelY] * m_layouts[levelIndex].rowPitch);
+            }
+        }
+
+        // not a std::vector, since that would write to every page of every level up front
+        m_storage.reset(new uint8[storageSize + ImageMips::c_alignment]);
+        m_data = (uint8*)ImageMips::AlignUp(size_t(m_storage.get()));
+        m_storageSize = storageSize;
+
+        for (size_t levelIndex = 0; levelIndex < m_levels.size(); ++levelIndex)
+        {
+            Image& image = m_levels[levelIndex];
+            image.pixels = PixelSpan<RGBU8>((RGBU8*)(m_data + m_layouts[levelIndex].offset), size_t(image.width) * size_t(image.height));
+        }
+
+        m_levelReady.reset(new std::atomic<bool>[m_levels.size()]);
+        m_levelOnce.reset(new std::once_flag[m_levels.size()]);
+        for (size_t levelIndex = 0; levelIndex < m_levels.size(); ++levelIndex)
+            m_levelReady[levelIndex].store(levelIndex == 0);
+
+        // level (0, 0) is the source image, so it's always ready
+        memcpy(m_levels[0].pixels.data(), pixels, width*height * sizeof(RGBU8));
+    }
+
+    RipMaps(const RipMaps&) = delete;
+    RipMaps& operator = (const RipMaps&) = delete;
+
+    int LevelsX() const { return m_levelsX; }
+    int LevelsY() const { return m_levelsY; }
+
+    // makes the level if it hasn't been made yet, and returns it
+    const Image& EnsureLevel(int levelX, int levelY)
+    {
+        size_t levelIndex = LevelIndex(levelX, levelY);
+
+        // the flag check keeps the common case down to a single load
+        if (m_levelReady[levelIndex].load(std::memory_order_acquire))
+            return m_levels[levelIndex];
+
+        std::call_once(m_levelOnce[levelIndex],
+            [&]()
+            {
+                MakeLevel(levelX, levelY);
+                m_levelsMade++;
+                m_levelReady[levelIndex].store(true, std::memory_order_release);
+            }
+        );
+        return m_levels[levelIndex];
+    }
+
+    // The image of a level, which is only valid once the level has been made
+    const Image& Level(int levelX, int levelY) const { return m_levels[LevelIndex(levelX, levelY)]; }
+    const MipLevelLayout& Layout(int levelX, int levelY) const { return m_layouts[LevelIndex(levelX, levelY)]; }
+
+    // the single allocation that holds every level
+    const uint8* Data() const { return m_data; }
+    size_t DataSize() const { return m_storageSize; }
+
+    // Counters, to see how much of the ripmap actually got used. Level (0, 0) doesn't count as made.
+    int LevelsMade() const { return m_levelsMade.load(); }
+    int LevelCount() const { return int(m_levels.size()); }
+    size_t BytesMade() const
+    {
+        size_t ret = 0;
+        for (size_t levelIndex = 1; levelIndex < m_levels.size(); ++levelIndex)
+        {
+            if (m_levelReady[levelIndex].load())
+                ret += size_t(m_levels[levelIndex].height) * m_layouts[levelIndex].rowPitch;
+        }
+        return ret;
+    }
+
+private:
+    size_t LevelIndex(int levelX, int levelY) const
+    {
+        return size_t(levelY) * m_levelsX + levelX;
+    }
+
+    void MakeLevel(int levelX, int levelY)
+    {
+        // halve both axes of the level diagonally up and to the left, or just one axis along the edges
+        int srcX = std::max(levelX - 1, 0);
+        int srcY = std::max(levelY - 1, 0);
+        const Image& src = EnsureLevel(srcX, srcY);
+        Image& dest = m_levels[LevelIndex(levelX, levelY)];
+        DownsampleBoxRows(src, dest, 0, dest.height, m_colorTables);
+    }
+
+    int m_levelsX = 0;
+    int m_levelsY = 0;
+    std::vector<Image> m_levels;
+    std::vector<MipLevelLayout> m_layouts;
+    std::unique_ptr<uint8[]> m_storage;
+    uint8* m_data = nullptr;
+    size_t m_storageSize = 0;
+
+    const ColorTables& m_colorTables;
+    std::unique_ptr<std::atomic<bool>[]> m_levelReady;
+    std::unique_ptr<std::once_flag[]> m_levelOnce;
+    std::atomic<int> m_levelsMade = { 0 };
+};
+
+// Which level to use on each axis, as fractional levels like the mip given to SampleTrilinear. Each comes from
+// how far the footprint of a pixel reaches along that axis of the texture, given how the uv changes per pixel
+// on x and y.
+inline void CalculateRipMapLevels(const RipMaps& ripMaps, const Vector2& d_uv_dx, const Vector2& d_uv_dy, float& levelX, float& levelY)
+{
+    const Image& level0 = ripMaps.Level(0, 0);
+    float lenu = std::max(std::fabsf(d_uv_dx[0]), std::fabsf(d_uv_dy[0])) * float(level0.width);
+    float lenv = std::max(std::fabsf(d_uv_dx[1]), std::fabsf(d_uv_dy[1])) * float(level0.height);
+    levelX = clamp(std::log2f(std::max(lenu, 1e-6f)), 0.0f, float(ripMaps.LevelsX() - 1));
+    levelY = clamp(std::log2f(std::max(lenv, 1e-6f)), 0.0f, float(ripMaps.LevelsY() - 1));
+}
+
+inline RGBU8 SampleBilinear(RipMaps& ripMaps, int levelX, int levelY, const Vector2& uv)
+{
+    levelX = std::min(levelX, ripMaps.LevelsX() - 1);
+    levelY = std::min(levelY, ripMaps.LevelsY() - 1);
+    return SampleBilinear(ripMaps.EnsureLevel(levelX, levelY), uv);
+}
+
+// Bilinear samples of the 4 levels around the fractional levels, blended on each axis like trilinear
+// sampling blends two mips.
+inline RGBU8 SampleRipMap(RipMaps& ripMaps, const Vector2& uv, float levelX, float levelY)
+{
+    int levelXInt = int(levelX);
+    int levelYInt = int(levelY);
+    float levelXFract = std::fmodf(levelX, 1.0f);
+    float levelYFract = std::fmodf(levelY, 1.0f);
+
+    // a whole level doesn't need the next one, which would get made just to be given a weight of 0
+    int levelXNext = (levelXFract > 0.0f) ? levelXInt + 1 : levelXInt;
+    int levelYNext = (levelYFract > 0.0f) ? levelYInt + 1 : levelYInt;
+
+    RGBU8 p00 = SampleBilinear(ripMaps, levelXInt, levelYInt, uv);
+    RGBU8 p10 = SampleBilinear(ripMaps, levelXNext, levelYInt, uv);
+    RGBU8 p01 = SampleBilinear(ripMaps, levelXInt, levelYNext, uv);
+    RGBU8 p11 = SampleBilinear(ripMaps, levelXNext, levelYNext, uv);
+
+    RGBU8 px0 = lerp(p00, p10, levelXFract);
+    RGBU8 px1 = lerp(p01, p11, levelXFract);
+    return lerp(px0, px1, levelYFract);
+}
+
+inline RGBU8 SampleRipMap(RipMaps& ripMaps, const Vector2& uv, const Vector2& d_uv_dx, const Vector2& d_uv_dy)
+{
+    float levelX, levelY;
+    CalculateRipMapLevels(ripMaps, d_uv_dx, d_uv_dy, levelX, levelY);
+    return SampleRipMap(ripMaps, uv, levelX, levelY);
+}
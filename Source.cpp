@@ -1,112 +1,105 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "MatrixMath.h"
+#include "AffineUVs.h"
+#include "AnisotropicSampling.h"
+#include "EWASampling.h"
+#include "FixedPointSampling.h"
+#include "FusedSampling.h"
+#include "BatchSampling.h"
 #include "Images.h"
+#include "LazyMips.h"
+#include "Mips.h"
+#include "MipCache.h"
+#include "MipDirtyRegions.h"
+#include "MipStreaming.h"
+#include "QuadRendering.h"
+#include "RipMaps.h"
+#include "SummedAreaTable.h"
+#include "TexelCacheSim.h"
 #include "Math.h"
 
+#include <chrono>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-void SaveCombinedImages2x2(const char* fileName, int width, int height, const RGBU8* p00, const RGBU8* p10, const RGBU8* p01, const RGBU8* p11)
+// A view of a rectangle of a bigger image, where each row starts stride pixels after the one before it
+struct ImageView
 {
-    std::vector<RGBU8> output;
-    output.resize((width * 2 + 1) * (height * 2 + 1));
+    RGBU8* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
 
-    for (int y = 0; y < height; ++y)
+    RGBU8* Row(int y) const
     {
-        RGBU8* dest00 = &output[y * (width * 2 + 1)];
-        RGBU8* dest10 = &output[y * (width * 2 + 1) + width + 1];
-        RGBU8* dest01 = &output[(y + height + 1) * (width * 2 + 1)];
-        RGBU8* dest11 = &output[(y + height + 1) * (width * 2 + 1) + width + 1];
-
-        int sourceIndex = y * width;
-
-        for (int x = 0; x < width; ++x)
-        {
-            dest00[0] = p00[sourceIndex];
-            dest10[0] = p10[sourceIndex];
-            dest01[0] = p01[sourceIndex];
-            dest11[0] = p11[sourceIndex];
-
-            ++dest00;
-            ++dest10;
-            ++dest01;
-            ++dest11;
-            ++sourceIndex;
-        }
+        return &pixels[size_t(y) * size_t(stride)];
     }
+};
 
-    stbi_write_png(fileName, width * 2 + 1, height * 2 + 1, 3, output.data(), 0);
-}
-
-// Make mips of an image, using a box filter. This is a common way to make mips.
-void MakeMips(ImageMips& mips, const uint8* pixels, int width, int height)
+// Four images of the same size in a 2x2 grid, with a black line between them. Each image gets drawn straight
+// into its quadrant through a view, instead of into an image of its own which then gets copied in.
+class CombinedImages2x2
 {
-    // calculate how many mips we need to make the longer axis reach 1 pixel in size.
-    int largestAxis = std::max(width, height);
-    int numMips = 0;
-    while (largestAxis)
+public:
+    CombinedImages2x2(int width, int height)
+        : m_width(width)
+        , m_height(height)
     {
-        largestAxis = largestAxis >> 1;
-        numMips++;
+        m_pixels.resize(size_t(Stride()) * size_t(height * 2 + 1));
     }
-    mips.resize(numMips);
 
-    // copy the full sized image as the first mip
-    mips[0].width = width;
-    mips[0].height = height;
-    mips[0].pixels.resize(width*height);
-    memcpy(mips[0].pixels.data(), pixels, width*height * sizeof(RGBU8));
-
-    // make the rest of the mips
-    for (int mipIndex = 1; mipIndex < numMips; ++mipIndex)
+    // 0 is the top left, 1 the top right, 2 the bottom left and 3 the bottom right
+    ImageView Quadrant(int quadrant)
     {
-        int srcWidth = mips[mipIndex - 1].width;
-        int srcHeight = mips[mipIndex - 1].height;
-
-        int destWidth = std::max(srcWidth / 2, 1);
-        int destHeight = std::max(srcHeight / 2, 1);
+        int x = (quadrant % 2) * (m_width + 1);
+        int y = (quadrant / 2) * (m_height + 1);
 
-        int widthRatio = srcWidth / destWidth;
-        int heightRatio = srcHeight / destHeight;
+        ImageView ret;
+        ret.pixels = &m_pixels[size_t(y) * size_t(Stride()) + x];
+        ret.width = m_width;
+        ret.height = m_height;
+        ret.stride = Stride();
+        return ret;
+    }
 
-        // set up the mip data and allocate memory for the pixels
-        mips[mipIndex].width = destWidth;
-        mips[mipIndex].height = destHeight;
-        mips[mipIndex].pixels.resize(destWidth*destHeight);
+    void Save(const char* fileName) const
+    {
+        stbi_write_png(fileName, Stride(), m_height * 2 + 1, 3, m_pixels.data(), 0);
+    }
 
-        const RGBU8* srcPixels = mips[mipIndex-1].pixels.data();
-        RGBU8* destPixel = mips[mipIndex].pixels.data();
+private:
+    int Stride() const
+    {
+        return m_width * 2 + 1;
+    }
 
-        for (int y = 0; y < destHeight; ++y)
-        {
-            for (int x = 0; x < destWidth; ++x)
-            {
-                // Make a mip pixel by averaging the 4 contributing pixels of the source image, and do it in linera space, not sRGB
-                // Due to the std::max call, it may not be 4 pixels contributing though.
-                int sampleCount = 0;
-                RGBF32 linearColor;
-                for (int iy = 0; iy < heightRatio; ++iy)
-                {
-                    for (int ix = 0; ix < widthRatio; ++ix)
-                    {
-                        linearColor += RGB_U8_To_F32(srcPixels[(y * heightRatio + iy)*srcWidth + (x * widthRatio + ix)]);
-                        ++sampleCount;
-                    }
-                }
-                linearColor *= 1.0f / float(sampleCount);
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<RGBU8> m_pixels;
+};
 
-                // convert back to sRGB U8 and write it in the destination pixel
-                *destPixel = RGB_F32_To_U8(linearColor);
+void SaveCombinedImages2x2(const char* fileName, int width, int height, const RGBU8* p00, const RGBU8* p10, const RGBU8* p01, const RGBU8* p11)
+{
+    CombinedImages2x2 output(width, height);
 
-                // move to the next destination pixel
-                ++destPixel;
-            }
-        }
+    const RGBU8* sources[4] = { p00, p10, p01, p11 };
+    for (int quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        ImageView dest = output.Quadrant(quadrant);
+        for (int y = 0; y < height; ++y)
+            memcpy(dest.Row(y), &sources[quadrant][y * width], width * sizeof(RGBU8));
     }
+
+    output.Save(fileName);
 }
 
 void SaveMips(const ImageMips& texture, const char* fileName)
@@ -139,10 +132,24 @@ void SaveMips(const ImageMips& texture, const char* fileName)
     stbi_write_png(fileName, width, height, 3, outputImage.data(), 0);
 }
 
-void TestMipMatrix(const ImageMips& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+template <typename T>
+void ToDisplayRow(const T* src, RGBU8* dest, int count)
 {
-    // TODO: multiplication order? Should matter with rotation.
+    for (int index = 0; index < count; ++index)
+        dest[index] = ToDisplay(src[index]);
+}
+
+// RGBF32 and RGBU8 are both tightly packed, so a row of them can be encoded as one run of floats
+void ToDisplayRow(const RGBF32* src, RGBU8* dest, int count)
+{
+    EncodeFromLinear(GetColorTables(ColorCurve::Gamma22), &src[0].r, &dest[0].r, count * 3);
+}
 
+// calculate what mip level we are going to be using.
+// It's constant across the whole image because transform is linear.
+template <typename TEXEL>
+float CalculateMip(const ImageMipsT<TEXEL>& texture, const Matrix33& uvtransform, int width, int height)
+{
     // account for the image scale in this transform
     float imageScaleX = float(texture[0].width) / float(width);
     float imageScaleY = float(texture[0].height) / float(height);
@@ -150,20 +157,6 @@ void TestMipMatrix(const ImageMips& texture, const Matrix33& uvtransform, int wi
 
     Matrix33 derivativesTransform = imageScale * uvtransform;
 
-    std::vector<RGBU8> nearestMip0;
-    std::vector<RGBU8> nearestMip;
-    std::vector<RGBU8> bilinear;
-    std::vector<RGBU8> trilinear;
-
-    nearestMip0.resize(width*height);
-    nearestMip.resize(width*height);
-    bilinear.resize(width*height);
-    trilinear.resize(width*height);
-
-
-
-    // calculate what mip level we are going to be using.
-    // It's constant across the whole image because transform is linear.
     Vector3 d_uv_dx_3 = Vector3{ 1.0f, 0.0f, 0.0f } * derivativesTransform;
     Vector3 d_uv_dy_3 = Vector3{ 0.0f, 1.0f, 0.0f } * derivativesTransform;
     Vector2 d_uv_dx = { d_uv_dx_3[0], d_uv_dx_3[1] };
@@ -171,53 +164,1164 @@ void TestMipMatrix(const ImageMips& texture, const Matrix33& uvtransform, int wi
     float lenx = std::sqrtf(Dot(d_uv_dx, d_uv_dx));
     float leny = std::sqrtf(Dot(d_uv_dy, d_uv_dy));
     float maxlen = std::max(lenx, leny);
-    float mip = clamp(std::log2f(maxlen), 0.0f, float(texture.size()-1));
-    int mipInt = clamp(int(mip), 0, int(texture.size() - 1));  // you could also add 0.5 before casting to int to round it. I felt that looked too blurry
+    return clamp(std::log2f(maxlen), 0.0f, float(texture.size()-1));
+}
+
+// TestMipMatrix renders in tiles of this many pixels on each side, spread across the thread pool
+static const int c_renderTileSize = 64;
+
+template <typename TEXEL>
+void TestMipMatrix(const ImageMipsT<TEXEL>& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+{
+    // TODO: multiplication order? Should matter with rotation.
+    typedef typename TexelTraits<TEXEL>::Filtered Filtered;
+
+    CombinedImages2x2 output(width, height);
+    ImageView nearestMip0 = output.Quadrant(0);
+    ImageView nearestMip = output.Quadrant(1);
+    ImageView bilinear = output.Quadrant(2);
+    ImageView trilinear = output.Quadrant(3);
+
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    // affine transforms step the uvs along each row instead of transforming every pixel
+    bool affine = IsAffine(uvtransform);
+    AffineUVs affineUVs = MakeAffineUVs(uvtransform, width, height);
+
+    // Each tile writes only its own pixels, and a pixel comes out the same whichever tile or thread does it,
+    // so the images don't depend on the thread count.
+    int tilesX = (width + c_renderTileSize - 1) / c_renderTileSize;
+    int tilesY = (height + c_renderTileSize - 1) / c_renderTileSize;
+    std::vector<double> tileMilliseconds(tilesX * tilesY);
+
+    ThreadPool& threadPool = GetThreadPool();
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    threadPool.ParallelForTasks(tilesX * tilesY,
+        [&](int tileIndex)
+        {
+            std::chrono::high_resolution_clock::time_point tileStart = std::chrono::high_resolution_clock::now();
+
+            int tileX = (tileIndex % tilesX) * c_renderTileSize;
+            int tileY = (tileIndex / tilesX) * c_renderTileSize;
+            int tileWidth = std::min(c_renderTileSize, width - tileX);
+            int tileHeight = std::min(c_renderTileSize, height - tileY);
+
+            // each row of the tile has its uvs worked out up front, and then is sampled at once, with every
+            // filter made from the same texel fetches
+            float rowU[c_renderTileSize];
+            float rowV[c_renderTileSize];
+            Filtered rowFiltered[4][c_renderTileSize];
+
+            FusedBatchOutput<Filtered> rowOut;
+            rowOut.nearestMip0 = rowFiltered[0];
+            rowOut.nearest = rowFiltered[1];
+            rowOut.bilinear = rowFiltered[2];
+            rowOut.trilinear = rowFiltered[3];
+
+            Vector3 percent = { 0.0f, 0.0f, 1.0f };
+            for (int y = tileY; y < tileY + tileHeight; ++y)
+            {
+                if (affine)
+                {
+                    MakeAffineRowUVs(affineUVs, y, tileX, tileWidth, rowU, rowV);
+                }
+                else
+                {
+                    percent[1] = PixelToUV(y, height);
+
+                    for (int x = 0; x < tileWidth; ++x)
+                    {
+                        percent[0] = PixelToUV(tileX + x, width);
+
+                        Vector3 uv3 = percent * uvtransform;
+                        rowU[x] = uv3[0];
+                        rowV[x] = uv3[1];
+                    }
+                }
+
+                SampleFusedBatch(texture, mip, c_sampleAll, rowU, rowV, rowOut, tileWidth);
+                ToDisplayRow(rowOut.nearestMip0, &nearestMip0.Row(y)[tileX], tileWidth);
+                ToDisplayRow(rowOut.nearest, &nearestMip.Row(y)[tileX], tileWidth);
+                ToDisplayRow(rowOut.bilinear, &bilinear.Row(y)[tileX], tileWidth);
+                ToDisplayRow(rowOut.trilinear, &trilinear.Row(y)[tileX], tileWidth);
+            }
+
+            tileMilliseconds[tileIndex] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tileStart).count();
+        }
+    );
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // the tile times, and the slowest tile, which bounds how well the render can spread across threads
+    int slowestTile = int(std::max_element(tileMilliseconds.begin(), tileMilliseconds.end()) - tileMilliseconds.begin());
+    double totalTileMilliseconds = 0.0;
+    for (double tileTime : tileMilliseconds)
+        totalTileMilliseconds += tileTime;
+    printf("%s: %0.2fms on %i threads, %i tiles averaging %0.3fms, slowest tile (%i, %i) %0.3fms\n", fileName, milliseconds,
+        threadPool.ThreadCount(), tilesX * tilesY, totalTileMilliseconds / double(tilesX * tilesY),
+        slowestTile % tilesX, slowestTile / tilesX, tileMilliseconds[slowestTile]);
+
+    output.Save(fileName);
+}
+
+// Compares trilinear sampling with the mip from the longer axis, like TestMipMatrix does, against anisotropic
+// sampling with a few different filters and budgets:
+//   trilinear             | anisotropic trilinear (16 fetches)
+//   anisotropic bilinear (16 fetches) | anisotropic bilinear (4 fetches)
+template <typename TEXEL>
+void TestAnisotropic(const ImageMipsT<TEXEL>& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+{
+    std::vector<RGBU8> trilinear(width*height);
+    std::vector<RGBU8> anisoTrilinear(width*height);
+    std::vector<RGBU8> anisoBilinear(width*height);
+    std::vector<RGBU8> anisoBilinearLow(width*height);
+
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    // the transform is linear, so the derivatives are the same at every pixel
+    Vector3 d_uv_dx_3 = Vector3{ 1.0f / float(width), 0.0f, 0.0f } * uvtransform;
+    Vector3 d_uv_dy_3 = Vector3{ 0.0f, 1.0f / float(height), 0.0f } * uvtransform;
+    Vector2 d_uv_dx = { d_uv_dx_3[0], d_uv_dx_3[1] };
+    Vector2 d_uv_dy = { d_uv_dy_3[0], d_uv_dy_3[1] };
 
     Vector3 percent = { 0.0f, 0.0f, 1.0f };
-    int outputIndex = 0;
     for (int y = 0; y < height; ++y)
     {
         percent[1] = PixelToUV(y, height);
-
         for (int x = 0; x < width; ++x)
         {
             percent[0] = PixelToUV(x, width);
+            Vector3 uv3 = percent * uvtransform;
+            Vector2 uv = { uv3[0], uv3[1] };
 
+            int outputIndex = y * width + x;
+            trilinear[outputIndex] = ToDisplay(SampleTrilinear(texture, uv, mip));
+            anisoTrilinear[outputIndex] = ToDisplay(SampleAnisotropic<SampleType::LinearMip>(texture, uv, d_uv_dx, d_uv_dy));
+            anisoBilinear[outputIndex] = ToDisplay(SampleAnisotropic<SampleType::Linear>(texture, uv, d_uv_dx, d_uv_dy));
+            anisoBilinearLow[outputIndex] = ToDisplay(SampleAnisotropic<SampleType::Linear>(texture, uv, d_uv_dx, d_uv_dy, 4));
+        }
+    }
+
+    SaveCombinedImages2x2(fileName, width, height, trilinear.data(), anisoTrilinear.data(), anisoBilinear.data(), anisoBilinearLow.data());
+}
+
+// Compares trilinear sampling and anisotropic sampling against ripmaps, for transforms that stretch the
+// texture along its axes:
+//   trilinear   | ripmap
+//   anisotropic | ripmap, bilinear from a single level
+void TestRipMap(RipMaps& ripMaps, const ImageMips& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+{
+    std::vector<RGBU8> trilinear(width*height);
+    std::vector<RGBU8> ripMap(width*height);
+    std::vector<RGBU8> anisotropic(width*height);
+    std::vector<RGBU8> ripMapLevel(width*height);
+
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    // the transform is linear, so the derivatives and levels are the same at every pixel
+    Vector3 d_uv_dx_3 = Vector3{ 1.0f / float(width), 0.0f, 0.0f } * uvtransform;
+    Vector3 d_uv_dy_3 = Vector3{ 0.0f, 1.0f / float(height), 0.0f } * uvtransform;
+    Vector2 d_uv_dx = { d_uv_dx_3[0], d_uv_dx_3[1] };
+    Vector2 d_uv_dy = { d_uv_dy_3[0], d_uv_dy_3[1] };
+
+    float levelX, levelY;
+    CalculateRipMapLevels(ripMaps, d_uv_dx, d_uv_dy, levelX, levelY);
+
+    Vector3 percent = { 0.0f, 0.0f, 1.0f };
+    for (int y = 0; y < height; ++y)
+    {
+        percent[1] = PixelToUV(y, height);
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
             Vector3 uv3 = percent * uvtransform;
             Vector2 uv = { uv3[0], uv3[1] };
 
-            nearestMip0[outputIndex] = SampleNearest(texture[0], uv);
-            nearestMip[outputIndex] = SampleNearest(texture[mipInt], uv);
-            bilinear[outputIndex] = SampleBilinear(texture[mipInt], uv);
+            int outputIndex = y * width + x;
             trilinear[outputIndex] = SampleTrilinear(texture, uv, mip);
+            ripMap[outputIndex] = SampleRipMap(ripMaps, uv, levelX, levelY);
+            anisotropic[outputIndex] = SampleAnisotropic(texture, uv, d_uv_dx, d_uv_dy);
+            ripMapLevel[outputIndex] = SampleBilinear(ripMaps, int(levelX), int(levelY), uv);
+        }
+    }
+
+    printf("%s: ripmap levels %0.2f, %0.2f. %i of %i levels made so far, %i KB of %i KB\n", fileName, levelX, levelY,
+        ripMaps.LevelsMade(), ripMaps.LevelCount() - 1, int(ripMaps.BytesMade() / 1024), int(ripMaps.DataSize() / 1024));
+
+    SaveCombinedImages2x2(fileName, width, height, trilinear.data(), ripMap.data(), anisotropic.data(), ripMapLevel.data());
+}
+
+// Compares trilinear and anisotropic sampling against box filtering with a summed area table:
+//   trilinear   | box of the pixel footprint
+//   anisotropic | box of 8x the pixel footprint
+// and times the boxes, which should cost the same no matter how big they are.
+void TestSummedAreaTable(const SummedAreaTable& table, const ImageMips& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+{
+    std::vector<RGBU8> trilinear(width*height);
+    std::vector<RGBU8> box(width*height);
+    std::vector<RGBU8> anisotropic(width*height);
+    std::vector<RGBU8> bigBox(width*height);
+
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    // the transform is linear, so the derivatives and footprint are the same at every pixel
+    Vector3 d_uv_dx_3 = Vector3{ 1.0f / float(width), 0.0f, 0.0f } * uvtransform;
+    Vector3 d_uv_dy_3 = Vector3{ 0.0f, 1.0f / float(height), 0.0f } * uvtransform;
+    Vector2 d_uv_dx = { d_uv_dx_3[0], d_uv_dx_3[1] };
+    Vector2 d_uv_dy = { d_uv_dy_3[0], d_uv_dy_3[1] };
+    Vector2 footprint = BoxFootprint(d_uv_dx, d_uv_dy);
+    Vector2 bigFootprint = { footprint[0] * 8.0f, footprint[1] * 8.0f };
+
+    double boxMilliseconds = 0.0;
+    double bigBoxMilliseconds = 0.0;
 
-            ++outputIndex;
+    std::vector<Vector2> rowUV(width);
+    Vector3 percent = { 0.0f, 0.0f, 1.0f };
+    for (int y = 0; y < height; ++y)
+    {
+        percent[1] = PixelToUV(y, height);
+
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
+            Vector3 uv3 = percent * uvtransform;
+            rowUV[x] = { uv3[0], uv3[1] };
+        }
+
+        int outputIndex = y * width;
+        for (int x = 0; x < width; ++x)
+        {
+            trilinear[outputIndex + x] = SampleTrilinear(texture, rowUV[x], mip);
+            anisotropic[outputIndex + x] = SampleAnisotropic(texture, rowUV[x], d_uv_dx, d_uv_dy);
+        }
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (int x = 0; x < width; ++x)
+            box[outputIndex + x] = SampleBox(table, rowUV[x], footprint);
+        std::chrono::high_resolution_clock::time_point middle = std::chrono::high_resolution_clock::now();
+        for (int x = 0; x < width; ++x)
+            bigBox[outputIndex + x] = SampleBox(table, rowUV[x], bigFootprint);
+        std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+        boxMilliseconds += std::chrono::duration<double, std::milli>(middle - start).count();
+        bigBoxMilliseconds += std::chrono::duration<double, std::milli>(end - middle).count();
+    }
+
+    printf("%s: box of %0.1f x %0.1f texels %0.2fms, box of %0.1f x %0.1f texels %0.2fms\n", fileName,
+        footprint[0] * float(table.Width()), footprint[1] * float(table.Height()), boxMilliseconds,
+        bigFootprint[0] * float(table.Width()), bigFootprint[1] * float(table.Height()), bigBoxMilliseconds);
+
+    SaveCombinedImages2x2(fileName, width, height, trilinear.data(), box.data(), anisotropic.data(), bigBox.data());
+}
+
+// mean absolute difference per channel
+float MeanAbsoluteError(const std::vector<RGBU8>& a, const std::vector<RGBU8>& b)
+{
+    double sum = 0.0;
+    for (size_t index = 0; index < a.size(); ++index)
+        sum += std::abs(a[index].r - b[index].r) + std::abs(a[index].g - b[index].g) + std::abs(a[index].b - b[index].b);
+    return float(sum / double(a.size() * 3));
+}
+
+// Compares trilinear, anisotropic and EWA sampling against brute force supersampling of mip 0, with the same
+// gaussian pixel filter EWA uses:
+//   trilinear   | EWA
+//   anisotropic | supersampled
+// and prints how long each took and how far each was from the supersampled image.
+void TestEWA(const ImageMips& texture, const Matrix33& uvtransform, int width, int height, const char* fileName)
+{
+    const int c_supersampleGrid = 16;
+
+    std::vector<RGBU8> trilinear(width*height);
+    std::vector<RGBU8> ewa(width*height);
+    std::vector<RGBU8> anisotropic(width*height);
+    std::vector<RGBU8> supersampled(width*height);
+
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    // the transform is linear, so the derivatives are the same at every pixel
+    Vector3 d_uv_dx_3 = Vector3{ 1.0f / float(width), 0.0f, 0.0f } * uvtransform;
+    Vector3 d_uv_dy_3 = Vector3{ 0.0f, 1.0f / float(height), 0.0f } * uvtransform;
+    Vector2 d_uv_dx = { d_uv_dx_3[0], d_uv_dx_3[1] };
+    Vector2 d_uv_dy = { d_uv_dy_3[0], d_uv_dy_3[1] };
+
+    // the uv of every pixel, so the timings are only of the sampling
+    std::vector<Vector2> uvs(width*height);
+    Vector3 percent = { 0.0f, 0.0f, 1.0f };
+    for (int y = 0; y < height; ++y)
+    {
+        percent[1] = PixelToUV(y, height);
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
+            Vector3 uv3 = percent * uvtransform;
+            uvs[y * width + x] = { uv3[0], uv3[1] };
+        }
+    }
+
+    auto TimeSampler = [&](std::vector<RGBU8>& output, const auto& sampleFn)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t index = 0; index < uvs.size(); ++index)
+            output[index] = sampleFn(uvs[index]);
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    double trilinearTime = TimeSampler(trilinear, [&](const Vector2& uv) { return SampleTrilinear(texture, uv, mip); });
+    double ewaTime = TimeSampler(ewa, [&](const Vector2& uv) { return SampleEWA(texture, uv, d_uv_dx, d_uv_dy); });
+    double anisotropicTime = TimeSampler(anisotropic, [&](const Vector2& uv) { return SampleAnisotropic(texture, uv, d_uv_dx, d_uv_dy); });
+
+    // a grid of bilinear samples of mip 0 spread over the pixel filter, which reaches a pixel out on each axis
+    double supersampledTime = TimeSampler(supersampled,
+        [&](const Vector2& uv)
+        {
+            RGBF32 sum;
+            float weightSum = 0.0f;
+            for (int sy = 0; sy < c_supersampleGrid; ++sy)
+            {
+                float offsetY = 2.0f * ((float(sy) + 0.5f) / float(c_supersampleGrid) - 0.5f);
+                for (int sx = 0; sx < c_supersampleGrid; ++sx)
+                {
+                    float offsetX = 2.0f * ((float(sx) + 0.5f) / float(c_supersampleGrid) - 0.5f);
+                    float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+                    if (distanceSquared >= 1.0f)
+                        continue;
+                    float weight = std::expf(-c_ewaGaussianAlpha * distanceSquared) - std::expf(-c_ewaGaussianAlpha);
+                    Vector2 sampleUV = { uv[0] + d_uv_dx[0] * offsetX + d_uv_dy[0] * offsetY, uv[1] + d_uv_dx[1] * offsetX + d_uv_dy[1] * offsetY };
+                    sum += AnisotropicTapToSum(SampleBilinear(texture[0], sampleUV)) * weight;
+                    weightSum += weight;
+                }
+            }
+            sum *= 1.0f / weightSum;
+
+            RGBU8 ret;
+            AnisotropicSumToTap(sum, ret);
+            return ret;
+        }
+    );
+
+    printf("%s: error from %ix%i supersampled (%0.1fms): trilinear %0.2f (%0.1fms), anisotropic %0.2f (%0.1fms), EWA %0.2f (%0.1fms)\n",
+        fileName, c_supersampleGrid, c_supersampleGrid, supersampledTime,
+        MeanAbsoluteError(trilinear, supersampled), trilinearTime,
+        MeanAbsoluteError(anisotropic, supersampled), anisotropicTime,
+        MeanAbsoluteError(ewa, supersampled), ewaTime);
+
+    SaveCombinedImages2x2(fileName, width, height, trilinear.data(), ewa.data(), anisotropic.data(), supersampled.data());
+}
+
+// The same as TestMipMatrix, but for any mapping from pixels to uvs, with the mip picked per 2x2 quad of
+// pixels instead of once for the whole image. The mapping is a projective Matrix33, or a function from the
+// pixel percent to the uv.
+template <typename MAPPING>
+void TestQuadMapping(const ImageMips& texture, const MAPPING& mapping, int width, int height, const char* fileName)
+{
+    CombinedImages2x2 output(width, height);
+    ImageView nearestMip0 = output.Quadrant(0);
+    ImageView nearestMip = output.Quadrant(1);
+    ImageView bilinear = output.Quadrant(2);
+    ImageView trilinear = output.Quadrant(3);
+
+    QuadRows rows;
+    for (int y = 0; y < height; y += 2)
+    {
+        MakeQuadRows(texture, mapping, width, height, y, rows);
+
+        for (int row = 0; row < rows.rowCount; ++row)
+        {
+            const float* u = rows.u[row].data();
+            const float* v = rows.v[row].data();
+
+            SampleNearestBatch(texture, 0, u, v, nearestMip0.Row(y + row), width);
+            SampleNearestBatch(texture, rows.mipIndex[row].data(), u, v, nearestMip.Row(y + row), width);
+            SampleBilinearBatch(texture, rows.mipIndex[row].data(), u, v, bilinear.Row(y + row), width);
+            SampleTrilinearBatch(texture, rows.mip[row].data(), u, v, trilinear.Row(y + row), width);
+        }
+    }
+
+    output.Save(fileName);
+}
+
+// Runs one of the samplers over the same uvs as TestMipMatrix through the cache model, and prints the stats of
+// each mip it read from.
+template <SampleType FILTER>
+void ReportSamplerCache(const ImageMips& texture, const Matrix33& uvtransform, int width, int height, float mip, const char* samplerName, const CacheConfig& config)
+{
+    TexelCacheSimulator simulator(config);
+    simulator.Begin(texture);
+
+    Vector3 percent = { 0.0f, 0.0f, 1.0f };
+    for (int y = 0; y < height; ++y)
+    {
+        percent[1] = PixelToUV(y, height);
+        for (int x = 0; x < width; ++x)
+        {
+            percent[0] = PixelToUV(x, width);
+            Vector3 uv3 = percent * uvtransform;
+            Sampler<FILTER>::Sample(texture, Vector2{ uv3[0], uv3[1] }, mip);
         }
     }
 
-    SaveCombinedImages2x2(fileName, width, height, nearestMip0.data(), nearestMip.data(), bilinear.data(), trilinear.data());
+    simulator.End();
+
+    for (size_t mipIndex = 0; mipIndex < simulator.Stats().size(); ++mipIndex)
+    {
+        const CacheStats& stats = simulator.Stats()[mipIndex];
+        if (stats.texelReads == 0)
+            continue;
+
+        printf("  %-12s mip %2i: %9llu texel reads %9llu line reads %9llu hits %9llu misses %10llu bytes (%5.2f bytes per pixel)\n",
+            samplerName, int(mipIndex), (unsigned long long)stats.texelReads, (unsigned long long)stats.lineReads,
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.bytesFetched,
+            double(stats.bytesFetched) / double(width * height));
+    }
+}
+
+// The cache stats for each of the samplers TestMipMatrix uses, for the same transform
+void ReportTexelCache(const ImageMips& texture, const Matrix33& uvtransform, int width, int height, const char* name, const CacheConfig& config)
+{
+    float mip = CalculateMip(texture, uvtransform, width, height);
+
+    printf("%s (%ix%i, mip %0.2f)\n", name, width, height, mip);
+    ReportSamplerCache<SampleType::Nearest>(texture, uvtransform, width, height, 0.0f, "nearest mip0", config);
+    ReportSamplerCache<SampleType::Nearest>(texture, uvtransform, width, height, mip, "nearest", config);
+    ReportSamplerCache<SampleType::Linear>(texture, uvtransform, width, height, mip, "bilinear", config);
+    ReportSamplerCache<SampleType::LinearMip>(texture, uvtransform, width, height, mip, "trilinear", config);
+}
+
+// Times bilinear sampling of mip 0 through rotated uvs, with each texel layout. Rotations make row major
+// sampling walk across the rows of the texture, which is where the tiled layouts should help.
+void BenchmarkTexelLayouts(ImageMips& texture, int width, int height)
+{
+    const float c_angles[] = { 0.0f, 20.0f, 45.0f, 90.0f };
+    const TexelLayout c_layouts[] = { TexelLayout::RowMajor, TexelLayout::Tiled, TexelLayout::Morton };
+    const char* c_layoutNames[] = { "row major", "tiled", "morton" };
+
+    printf("%ix%i texture sampled at %ix%i\n", texture[0].width, texture[0].height, width, height);
+    for (int layoutIndex = 0; layoutIndex < 3; ++layoutIndex)
+    {
+        ConvertTexelLayout(texture, c_layouts[layoutIndex]);
+        printf("%-10s", c_layoutNames[layoutIndex]);
+
+        for (float angle : c_angles)
+        {
+            Matrix33 uvtransform = Rotation33(DegreesToRadians(angle));
+
+            // the sum of the samples is the same for every layout, and keeps the sampling from being optimized out
+            unsigned int checksum = 0;
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+            Vector3 percent = { 0.0f, 0.0f, 1.0f };
+            for (int y = 0; y < height; ++y)
+            {
+                percent[1] = PixelToUV(y, height);
+                for (int x = 0; x < width; ++x)
+                {
+                    percent[0] = PixelToUV(x, width);
+                    Vector3 uv3 = percent * uvtransform;
+                    RGBU8 color = SampleBilinear(texture[0], Vector2{ uv3[0], uv3[1] });
+                    checksum += color.r + color.g + color.b;
+                }
+            }
+
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("  %2.0f deg: %7.2fms (%08x)", angle, milliseconds, checksum);
+        }
+        printf("\n");
+    }
+
+    ConvertTexelLayout(texture, TexelLayout::RowMajor);
+}
+
+void BenchmarkTexelLayouts(const ImageMips& texture)
+{
+    // the texture itself, which is small enough to mostly stay in cache
+    ImageMips small;
+    MakeMips(small, &texture[0].pixels[0].r, texture[0].width, texture[0].height);
+    BenchmarkTexelLayouts(small, texture[0].width, texture[0].height);
+
+    // the texture repeated 8x8 times, which is too big for the cache, sampled at a quarter of the texels
+    int largeWidth = texture[0].width * 8;
+    int largeHeight = texture[0].height * 8;
+    std::vector<RGBU8> largePixels(size_t(largeWidth) * largeHeight);
+    for (int y = 0; y < largeHeight; ++y)
+        for (int x = 0; x < largeWidth; ++x)
+            largePixels[size_t(y) * largeWidth + x] = texture[0].pixels[(y % texture[0].height) * texture[0].width + x % texture[0].width];
+
+    ImageMips large;
+    MakeMips(large, &largePixels[0].r, largeWidth, largeHeight);
+    BenchmarkTexelLayouts(large, largeWidth / 2, largeHeight / 2);
+}
+
+// How many of the channels differ between two sets of mips of the same size, and by how much at most
+size_t CompareMips(const ImageMips& a, const ImageMips& b, int& maxDifference)
+{
+    size_t channelsDiffering = 0;
+    maxDifference = 0;
+    for (size_t mipIndex = 0; mipIndex < a.size(); ++mipIndex)
+    {
+        for (size_t index = 0; index < a[mipIndex].pixels.size() * 3; ++index)
+        {
+            int difference = std::abs(int((&a[mipIndex].pixels[0].r)[index]) - int((&b[mipIndex].pixels[0].r)[index]));
+            channelsDiffering += (difference != 0) ? 1 : 0;
+            maxDifference = std::max(maxDifference, difference);
+        }
+    }
+    return channelsDiffering;
+}
+
+// Times making mips with each generator, from the texture repeated out to 4096x4096, on the thread pool and
+// on one thread. Each time is the best of a few runs. Also reports how far each generator's mips are from
+// MakeMips.
+void BenchmarkMipGenerators(const ImageMips& texture)
+{
+    const int c_size = 4096;
+    std::vector<RGBU8> pixels(size_t(c_size) * c_size);
+    for (int y = 0; y < c_size; ++y)
+        for (int x = 0; x < c_size; ++x)
+            pixels[size_t(y) * c_size + x] = texture[0].pixels[(y % texture[0].height) * texture[0].width + x % texture[0].width];
+
+    struct Generator
+    {
+        const char* name;
+        MipSettings settings;
+    };
+    std::vector<Generator> generators(2);
+    generators[0].name = "makemips";
+    generators[1].name = "singlepass";
+    generators[1].settings.generator = MipGenerator::MakeMipsSinglePass;
+    for (int filterIndex = 0; filterIndex < c_mipFilterCount; ++filterIndex)
+    {
+        Generator generator;
+        generator.name = c_mipFilterNames[filterIndex];
+        generator.settings.generator = MipGenerator::MakeMipsFiltered;
+        generator.settings.filter = MipFilter(filterIndex);
+        generators.push_back(generator);
+    }
+
+    ImageMips reference;
+    MakeMips(reference, &pixels[0].r, c_size, c_size);
+
+    ThreadPool singleThread(1);
+    printf("making mips of %ix%i\n", c_size, c_size);
+    for (const Generator& generator : generators)
+    {
+        ImageMips mips;
+        double milliseconds[2] = { 1e30, 1e30 };
+        for (int run = 0; run < 5; ++run)
+        {
+            for (int pool = 0; pool < 2; ++pool)
+            {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                MakeMipsWithSettings(mips, &pixels[0].r, c_size, c_size, generator.settings, pool == 0 ? GetThreadPool() : singleThread);
+                milliseconds[pool] = std::min(milliseconds[pool], std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+            }
+        }
+
+        int maxDifference = 0;
+        size_t channelsDiffering = CompareMips(mips, reference, maxDifference);
+
+        printf("  %-12s %7.2fms on %i threads, %7.2fms on 1 thread, %zu channels differ from makemips by up to %i\n", generator.name,
+            milliseconds[0], GetThreadPool().ThreadCount(), milliseconds[1], channelsDiffering, maxDifference);
+    }
+}
+
+// Edits a few rects of mip 0, some overlapping, and remakes the mips with MipDirtyRegions. Checks that they come
+// out the same as a full rebuild, and reports how much work that saved.
+void CheckMipDirtyRegions(const ImageMips& texture)
+{
+    int width = texture[0].width;
+    int height = texture[0].height;
+    std::vector<RGBU8> pixels(texture[0].pixels.begin(), texture[0].pixels.end());
+
+    ImageMips mips;
+    MakeMips(mips, &pixels[0].r, width, height);
+
+    // two of the rects overlap, and one hangs off of the edge of the image
+    const PixelRect c_edits[] =
+    {
+        { 10, 10, 40, 30 },
+        { 30, 20, 70, 50 },
+        { 200, 100, 260, 180 },
+        { width - 20, height - 8, width + 10, height + 10 }
+    };
+
+    MipDirtyRegions dirtyRegions;
+    for (const PixelRect& edit : c_edits)
+    {
+        for (int y = std::max(edit.y0, 0); y < std::min(edit.y1, height); ++y)
+        {
+            for (int x = std::max(edit.x0, 0); x < std::min(edit.x1, width); ++x)
+            {
+                RGBU8& pixel = pixels[y * width + x];
+                pixel = RGBU8{ uint8(255 - pixel.r), uint8(255 - pixel.g), uint8(255 - pixel.b) };
+                mips[0].pixels[y * width + x] = pixel;
+            }
+        }
+        dirtyRegions.AddDirtyRect(edit.x0, edit.y0, edit.x1, edit.y1);
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    long long pixelsRemade = dirtyRegions.Update(mips);
+    double updateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    ImageMips reference;
+    start = std::chrono::high_resolution_clock::now();
+    MakeMips(reference, &pixels[0].r, width, height);
+    double rebuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    long long pixelsTotal = 0;
+    for (size_t mipIndex = 1; mipIndex < reference.size(); ++mipIndex)
+        pixelsTotal += (long long)reference[mipIndex].width * (long long)reference[mipIndex].height;
+
+    int maxDifference = 0;
+    size_t channelsDiffering = CompareMips(mips, reference, maxDifference);
+    printf("dirty regions: %i edits remade %lld of %lld mip pixels (%0.1f%%) in %0.3fms, against %0.3fms for a full rebuild. %s, %zu channels differ by up to %i\n",
+        int(sizeof(c_edits) / sizeof(c_edits[0])), pixelsRemade, pixelsTotal, 100.0 * double(pixelsRemade) / double(pixelsTotal),
+        updateMilliseconds, rebuildMilliseconds, channelsDiffering == 0 ? "passed" : "FAILED", channelsDiffering, maxDifference);
+}
+
+// Renders the translation tests, and the scale test which falls between two mips, through the lazy mip
+// samplers, in the same layout as TestMipMatrix:
+//   nearest of mip 0 | nearest of the mip
+//   bilinear         | trilinear
+// Each test starts from fresh lazy mips, and prints which mips got touched and how many of their tiles got made,
+// along with how many pixels came out different from sampling mips made up front.
+void TestLazyMips(const ImageMips& texture)
+{
+    int width = texture[0].width;
+    int height = texture[0].height;
+
+    ImageMips reference;
+    MakeMips(reference, &texture[0].pixels[0].r, width, height);
+
+    struct LazyTest
+    {
+        Matrix33 uvtransform;
+        const char* fileName;
+    };
+    const LazyTest c_tests[] =
+    {
+        { c_identity33, "out/lazytranslation0.png" },
+        { Translate33({ 0.75f / float(width), 0.0f }), "out/lazytranslation1.png" },
+        { Translate33({ 0.2f, 0.2f }), "out/lazytranslation.png" },
+        { Scale33({ 3.0f, 1.0f, 1.0f }), "out/lazyscale.png" }
+    };
+
+    for (const LazyTest& test : c_tests)
+    {
+        LazyImageMips lazyMips(&texture[0].pixels[0].r, width, height);
+
+        std::vector<RGBU8> nearestMip0(width*height);
+        std::vector<RGBU8> nearestMip(width*height);
+        std::vector<RGBU8> bilinear(width*height);
+        std::vector<RGBU8> trilinear(width*height);
+        std::atomic<int> pixelsDiffering = { 0 };
+
+        float mip = CalculateMip(reference, test.uvtransform, width, height);
+        int mipIndex = std::min(int(mip), (int)reference.size() - 1);
+
+        // the bands run at once, so the tiles get made from several threads
+        ThreadPool& threadPool = GetThreadPool();
+        threadPool.ParallelFor(height, std::max(height / (threadPool.ThreadCount() * 4), 1),
+            [&](int yBegin, int yEnd)
+            {
+                int bandDiffering = 0;
+                Vector3 percent = { 0.0f, 0.0f, 1.0f };
+                for (int y = yBegin; y < yEnd; ++y)
+                {
+                    percent[1] = PixelToUV(y, height);
+                    for (int x = 0; x < width; ++x)
+                    {
+                        percent[0] = PixelToUV(x, width);
+                        Vector3 uv3 = percent * test.uvtransform;
+                        Vector2 uv = { uv3[0], uv3[1] };
+
+                        int outputIndex = y * width + x;
+                        nearestMip0[outputIndex] = SampleNearest(lazyMips, 0, uv);
+                        nearestMip[outputIndex] = SampleNearest(lazyMips, mipIndex, uv);
+                        bilinear[outputIndex] = SampleBilinear(lazyMips, mipIndex, uv);
+                        trilinear[outputIndex] = SampleTrilinear(lazyMips, uv, mip);
+
+                        RGBU8 expected[4] =
+                        {
+                            SampleNearest(reference[0], uv),
+                            SampleNearest(reference[mipIndex], uv),
+                            SampleBilinear(reference[mipIndex], uv),
+                            SampleTrilinear(reference, uv, mip)
+                        };
+                        RGBU8 actual[4] = { nearestMip0[outputIndex], nearestMip[outputIndex], bilinear[outputIndex], trilinear[outputIndex] };
+                        bandDiffering += (memcmp(expected, actual, sizeof(expected)) == 0) ? 0 : 1;
+                    }
+                }
+                pixelsDiffering += bandDiffering;
+            }
+        );
+
+        printf("%s: %i pixels differ from mips made up front\n", test.fileName, pixelsDiffering.load());
+        for (int index = 0; index < int(lazyMips.size()); ++index)
+        {
+            printf("  mip %i: %s, %i of %i tiles made\n", index, lazyMips.LevelTouched(index) ? "touched" : "untouched",
+                lazyMips.TilesMade(index), lazyMips.TileCount(index));
+        }
+
+        SaveCombinedImages2x2(test.fileName, width, height, nearestMip0.data(), nearestMip.data(), bilinear.data(), trilinear.data());
+    }
+}
+
+// Streams scenery.png through StreamingMipBuilder in strips to a mip cache file, loads that back with
+// LoadMipCache(), and checks it against MakeMips. Reports the most memory the builder held, against the size
+// of the whole pyramid.
+void CheckStreamingMips()
+{
+    // an odd strip size, so that strips end partway through the blocks of rows the mips are made from
+    const int c_stripRows = 37;
+    const char* c_fileName = "scenery.streamed.mipcache";
+
+    int width, height, numChannels;
+    uint8* image = stbi_load("scenery.png", &width, &height, &numChannels, 3);
+    if (!image)
+    {
+        printf("streaming mips: couldn't load scenery.png\n");
+        return;
+    }
+
+    // the same key the cache of MakeMips would have, since the mips come out the same
+    uint64 cacheKey = MakeMipCacheKey("scenery.png", MipSettings());
+
+    size_t bufferBytes = 0;
+    bool written = false;
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    {
+        StreamingMipBuilder builder;
+        written = builder.Begin(c_fileName, width, height, cacheKey);
+        for (int y = 0; y < height && written; y += c_stripRows)
+            written = builder.AddRows(&image[size_t(y) * width * 3], std::min(c_stripRows, height - y));
+        written = builder.Finish() && written;
+        bufferBytes = builder.BufferBytes();
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    {
+        ImageMips reference;
+        MakeMips(reference, image, width, height);
+
+        ImageMips streamed;
+        bool loaded = written && LoadMipCache(c_fileName, cacheKey, streamed);
+
+        int maxDifference = 0;
+        size_t channelsDiffering = loaded ? CompareMips(streamed, reference, maxDifference) : 0;
+        printf("streaming mips: strips of %i rows written in %0.2fms. Builder held %zu KB at most, plus %zu KB for a strip, against %zu KB for all of the mips. %s, %zu channels differ by up to %i\n",
+            c_stripRows, milliseconds, bufferBytes / 1024, size_t(c_stripRows) * width * 3 / 1024, reference.DataSize() / 1024,
+            (loaded && channelsDiffering == 0) ? "passed" : "FAILED", channelsDiffering, maxDifference);
+    }
+
+    remove(c_fileName);
+    stbi_image_free(image);
+}
+
+// Samples with per sample mips that are out of the range of the mip chain, through the AVX2 batch and through
+// the single sample version with the mip clamped, and checks that they agree.
+void CheckBatchMipClamping(const ImageMips& texture)
+{
+    // more than 8, so the AVX2 batch and the loop after it both get some
+    const float c_mips[] = { -2.0f, -0.5f, 100.0f, float(texture.size()) - 0.5f, 1.25f, -1.0f, 0.0f, float(texture.size()), -100.0f, 3.75f, 1e9f };
+    const int c_count = int(sizeof(c_mips) / sizeof(c_mips[0]));
+
+    float u[c_count];
+    float v[c_count];
+    for (int index = 0; index < c_count; ++index)
+    {
+        u[index] = 0.137f * float(index) - 0.3f;
+        v[index] = 0.611f - 0.093f * float(index);
+    }
+
+    RGBU8 batch[c_count];
+    SampleTrilinearBatch(texture, c_mips, u, v, batch, c_count);
+
+    int samplesDiffering = 0;
+    for (int index = 0; index < c_count; ++index)
+    {
+        RGBU8 expected = SampleTrilinear(texture, Vector2{ u[index], v[index] }, ClampMip(c_mips[index], texture.size()));
+        samplesDiffering += (memcmp(&expected, &batch[index], sizeof(RGBU8)) == 0) ? 0 : 1;
+    }
+    printf("batch mip clamping: %s, %i of %i samples differ\n", samplesDiffering == 0 ? "passed" : "FAILED", samplesDiffering, c_count);
+}
+
+// Calls ParallelFor() and ParallelForTasks() from inside of bands and tasks of each other, on a pool of 4
+// threads, and checks that every inner call gets made. The thread that starts a job works on it too, so some
+// of the nested calls come from it and some from the workers. Either way they should run serially instead of
+// waiting on the pool, which is busy with the outer job.
+void CheckNestedParallelCalls()
+{
+    const int c_outerCount = 16;
+    const int c_innerCount = 64;
+    const char* c_names[] = { "ParallelFor", "ParallelForTasks" };
+
+    ThreadPool threadPool(4);
+    std::atomic<int> calls = { 0 };
+
+    auto Inner = [&](int innerKind)
+    {
+        if (innerKind == 0)
+            threadPool.ParallelFor(c_innerCount, 4, [&](int begin, int end) { calls += end - begin; });
+        else
+            threadPool.ParallelForTasks(c_innerCount, [&](int) { calls++; });
+    };
+
+    for (int outerKind = 0; outerKind < 2; ++outerKind)
+    {
+        for (int innerKind = 0; innerKind < 2; ++innerKind)
+        {
+            calls = 0;
+            if (outerKind == 0)
+            {
+                threadPool.ParallelFor(c_outerCount, 1,
+                    [&](int begin, int end)
+                    {
+                        for (int index = begin; index < end; ++index)
+                            Inner(innerKind);
+                    }
+                );
+            }
+            else
+            {
+                threadPool.ParallelForTasks(c_outerCount, [&](int) { Inner(innerKind); });
+            }
+
+            printf("nested %s in %s: %s, %i of %i calls made\n", c_names[innerKind], c_names[outerKind],
+                calls == c_outerCount * c_innerCount ? "passed" : "FAILED", calls.load(), c_outerCount * c_innerCount);
+        }
+    }
+}
+
+// Samples RGBF32 and RGBF16 mips through the bilinear and trilinear batch samplers, which use AVX2 for those
+// formats, and through the single sample versions, and reports how far apart they are.
+template <typename TEXEL>
+void CheckLinearBatchSampling(const ImageMips& texture, const char* formatName)
+{
+    ImageMipsT<TEXEL> mips;
+    MakeMips(mips, &texture[0].pixels[0].r, texture[0].width, texture[0].height);
+
+    // a count that isn't a multiple of 8, so the loop after the AVX2 path gets some too
+    const int c_count = 1001;
+    std::vector<float> u(c_count), v(c_count), mipValues(c_count);
+    std::vector<int> mipIndices(c_count);
+    for (int index = 0; index < c_count; ++index)
+    {
+        u[index] = 0.0137f * float(index) - 3.1f;
+        v[index] = 2.3f - 0.0071f * float(index);
+        mipValues[index] = float(index % 97) * 0.11f - 1.0f;
+        mipIndices[index] = index % 13 - 2;
+    }
+
+    std::vector<RGBF32> batch(c_count);
+    float maxDifference = 0.0f;
+    auto Compare = [&](int index, const RGBF32& expected)
+    {
+        maxDifference = std::max(maxDifference, std::fabsf(batch[index].r - expected.r));
+        maxDifference = std::max(maxDifference, std::fabsf(batch[index].g - expected.g));
+        maxDifference = std::max(maxDifference, std::fabsf(batch[index].b - expected.b));
+    };
+
+    SampleBilinearBatch(mips, 2, u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleBilinear(mips[2], Vector2{ u[index], v[index] }));
+
+    SampleBilinearBatch(mips, mipIndices.data(), u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleBilinear(mips[ClampMipIndex(mipIndices[index], mips.size())], Vector2{ u[index], v[index] }));
+
+    SampleTrilinearBatch(mips, 1.3f, u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleTrilinear(mips, Vector2{ u[index], v[index] }, 1.3f));
+
+    SampleTrilinearBatch(mips, mipValues.data(), u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleTrilinear(mips, Vector2{ u[index], v[index] }, ClampMip(mipValues[index], mips.size())));
+
+    printf("%s batch sampling: %s, largest difference from the single sample versions %g\n", formatName,
+        maxDifference <= 1e-6f ? "passed" : "FAILED", maxDifference);
+}
+
+// Makes the stepped uvs for the affine transforms the tests render with, and checks how far they get from
+// transforming each pixel with the vector matrix multiply, in texels of mip 0.
+void CheckAffineUVs(const ImageMips& texture)
+{
+    const float c_maxTexelError = 0.001f;
+    int width = texture[0].width;
+    int height = texture[0].height;
+
+    struct Transform
+    {
+        Matrix33 uvtransform;
+        int width;
+        int height;
+        const char* name;
+    };
+    const Transform c_transforms[] =
+    {
+        { c_identity33, width, height, "identity" },
+        { Translate33({ 0.75f / float(width), 0.0f }), width, height, "subpixel translation" },
+        { Translate33({ 0.2f, 0.2f }), width, height, "translation" },
+        { Scale33({ 3.0f, 1.0f, 1.0f }), width, height, "scale" },
+        { Rotation33(DegreesToRadians(90.0f)), width, height, "rot90" },
+        { Rotation33(DegreesToRadians(20.0f)), width, height, "rot20" },
+        { Rotation33(DegreesToRadians(20.0f)), width * 2, height * 2, "rot20large" }
+    };
+
+    for (const Transform& transform : c_transforms)
+    {
+        AffineUVs affine = MakeAffineUVs(transform.uvtransform, transform.width, transform.height);
+        Vector2 uvError = MeasureAffineUVError(affine, transform.uvtransform, transform.width, transform.height);
+        float errorU = uvError[0] * float(width);
+        float errorV = uvError[1] * float(height);
+        printf("affine uvs %s: %s, %0.6f texels on u, %0.6f texels on v\n", transform.name,
+            (errorU <= c_maxTexelError && errorV <= c_maxTexelError) ? "passed" : "FAILED", errorU, errorV);
+    }
+}
+
+// Samples through the fixed point batch samplers, which use AVX2 for most of the samples, and checks that they
+// match the scalar fixed point samplers exactly. Some of the mips are outside of the mip chain, which both
+// clamp to it.
+void CheckFixedPointBatchSampling(const ImageMips& texture)
+{
+    const int c_count = 1001;
+    std::vector<float> u(c_count), v(c_count), mips(c_count);
+    for (int index = 0; index < c_count; ++index)
+    {
+        u[index] = 0.0137f * float(index) - 3.1f;
+        v[index] = 2.3f - 0.0071f * float(index);
+        mips[index] = float(index % 97) * 0.17f - 3.0f;
+    }
+
+    std::vector<RGBU8> batch(c_count);
+    int samplesDiffering = 0;
+    auto Compare = [&](int index, const RGBU8& expected)
+    {
+        samplesDiffering += (memcmp(&expected, &batch[index], sizeof(RGBU8)) == 0) ? 0 : 1;
+    };
+
+    SampleBilinearFixedBatch(texture, 2, u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleBilinearFixed(texture[2], Vector2{ u[index], v[index] }));
+
+    SampleTrilinearFixedBatch(texture, 1.3f, u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleTrilinearFixed(texture, Vector2{ u[index], v[index] }, 1.3f));
+
+    SampleTrilinearFixedBatch(texture, mips.data(), u.data(), v.data(), batch.data(), c_count);
+    for (int index = 0; index < c_count; ++index)
+        Compare(index, SampleTrilinearFixed(texture, Vector2{ u[index], v[index] }, ClampMip(mips[index], texture.size())));
+
+    printf("fixed point batch sampling: %s, %i of %i samples differ\n", samplesDiffering == 0 ? "passed" : "FAILED", samplesDiffering, c_count * 3);
+}
+
+// Compares TexelAddress<MODE, POW2> against addressing worked out the slow way, with a floor division into
+// copies of the image, for coordinates well outside of the image on both sides and some very large ones.
+// Then checks that a power of two mip chain, which the batch samplers send down the POW2 path, samples the
+// same as the general path.
+void CheckTexelAddressing(const ImageMips& texture)
+{
+    auto Reference = [](AddressMode mode, int coord, int size)
+    {
+        long long copy = coord >= 0 ? coord / size : -((-(long long)coord + size - 1) / size);
+        int ret = int((long long)coord - copy * size);
+        switch (mode)
+        {
+            case AddressMode::Wrap: return ret;
+            case AddressMode::Clamp: return coord < 0 ? 0 : (coord >= size ? size - 1 : coord);
+            case AddressMode::Mirror: return (copy & 1) ? size - 1 - ret : ret;
+            case AddressMode::Border: return (copy == 0) ? ret : -1;
+        }
+        return ret;
+    };
+
+    const int c_largeCoords[] = { INT_MIN, INT_MIN + 1, -1000000007, -(1 << 30), 1 << 30, 1000000007, INT_MAX - 1, INT_MAX };
+
+    const int c_sizes[] = { 1, 2, 3, 5, 8, 64, 256, 341 };
+    int addressesChecked = 0;
+    int addressesDiffering = 0;
+    for (int size : c_sizes)
+    {
+        std::vector<int> coords(std::begin(c_largeCoords), std::end(c_largeCoords));
+        for (int coord = -3 * size - 5; coord <= 3 * size + 5; ++coord)
+            coords.push_back(coord);
+
+        for (int coord : coords)
+        {
+            int addresses[] =
+            {
+                TexelAddress<AddressMode::Wrap, false>::Address(coord, size),
+                TexelAddress<AddressMode::Clamp, false>::Address(coord, size),
+                TexelAddress<AddressMode::Mirror, false>::Address(coord, size),
+                TexelAddress<AddressMode::Border, false>::Address(coord, size),
+                TexelAddress<AddressMode::Wrap, true>::Address(coord, size),
+                TexelAddress<AddressMode::Clamp, true>::Address(coord, size),
+                TexelAddress<AddressMode::Mirror, true>::Address(coord, size),
+                TexelAddress<AddressMode::Border, true>::Address(coord, size)
+            };
+
+            // the POW2 versions only get used with power of two sizes
+            int addressCount = IsPowerOfTwo(size) ? 8 : 4;
+            for (int index = 0; index < addressCount; ++index)
+                addressesDiffering += (addresses[index] == Reference(AddressMode(index % 4), coord, size)) ? 0 : 1;
+            addressesChecked += addressCount;
+        }
+    }
+    printf("texel addressing: %s, %i of %i addresses differ\n", addressesDiffering == 0 ? "passed" : "FAILED", addressesDiffering, addressesChecked);
+
+    // a 256x128 corner of the texture
+    const int c_width = 256;
+    const int c_height = 128;
+    std::vector<uint8> pixels(c_width * c_height * 3);
+    for (int y = 0; y < c_height; ++y)
+    {
+        for (int x = 0; x < c_width; ++x)
+            memcpy(&pixels[(y * c_width + x) * 3], &ReadTexel(texture[0], x, y), 3);
+    }
+    ImageMips pow2Mips;
+    MakeMips(pow2Mips, pixels.data(), c_width, c_height);
+
+    const int c_count = 1001;
+    std::vector<float> u(c_count), v(c_count), mips(c_count);
+    for (int index = 0; index < c_count; ++index)
+    {
+        u[index] = 0.0137f * float(index) - 5.1f;
+        v[index] = 4.3f - 0.0113f * float(index);
+        mips[index] = float(index % 89) * 0.1f;
+    }
+
+    // the template, so that none of the samples go down the AVX2 path
+    std::vector<RGBU8> batch(c_count);
+    SampleTrilinearBatch<RGBU8>(pow2Mips, mips.data(), u.data(), v.data(), batch.data(), c_count);
+    int samplesDiffering = 0;
+    for (int index = 0; index < c_count; ++index)
+    {
+        RGBU8 expected = SampleTrilinear<AddressMode::Wrap, false>(pow2Mips, Vector2{ u[index], v[index] }, ClampMip(mips[index], pow2Mips.size()));
+        samplesDiffering += (memcmp(&expected, &batch[index], sizeof(RGBU8)) == 0) ? 0 : 1;
+    }
+    printf("power of two batch sampling: %s, %i of %i samples differ\n", samplesDiffering == 0 ? "passed" : "FAILED", samplesDiffering, c_count);
 }
 
 int main(int argc, char **argv)
 {
+    // Options that can come before any of the others:
+    //   -threads <count> sets how many threads the thread pool has. 0, the default, means one per hardware thread.
+    //   -mipgen <makemips|singlepass|filtered> picks how the mips get made.
+    //   -mipfilter <box|triangle|mitchell|lanczos3|kaiser> picks the filter for -mipgen filtered.
+    MipSettings mipSettings;
+    while (argc > 2)
+    {
+        if (strcmp(argv[1], "-threads") == 0)
+            ThreadPoolThreadCountSetting() = std::max(atoi(argv[2]), 0);
+        else if (strcmp(argv[1], "-mipgen") == 0)
+        {
+            if (strcmp(argv[2], "singlepass") == 0)
+                mipSettings.generator = MipGenerator::MakeMipsSinglePass;
+            else if (strcmp(argv[2], "filtered") == 0)
+                mipSettings.generator = MipGenerator::MakeMipsFiltered;
+            else
+                mipSettings.generator = MipGenerator::MakeMips;
+        }
+        else if (strcmp(argv[1], "-mipfilter") == 0)
+        {
+            for (int filterIndex = 0; filterIndex < c_mipFilterCount; ++filterIndex)
+            {
+                if (strcmp(argv[2], c_mipFilterNames[filterIndex]) == 0)
+                    mipSettings.filter = MipFilter(filterIndex);
+            }
+        }
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+
     // Load the scenery image and make mips. Save them out for the blog post too.
+    // The mips are cached in a file, which later runs memory map instead, as long as the image and settings are the same.
     ImageMips texture;
     {
-        int width, height, numChannels;
-        uint8* image = stbi_load("scenery.png", &width, &height, &numChannels, 3);
-        MakeMips(texture, image, width, height);
-        stbi_image_free(image);
+        uint64 cacheKey = MakeMipCacheKey("scenery.png", mipSettings);
+        if (!LoadMipCache("scenery.mipcache", cacheKey, texture))
+        {
+            int width, height, numChannels;
+            uint8* image = stbi_load("scenery.png", &width, &height, &numChannels, 3);
+            MakeMipsWithSettings(texture, image, width, height, mipSettings);
+            stbi_image_free(image);
+            SaveMipCache("scenery.mipcache", texture, cacheKey);
+        }
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-benchmips") == 0)
+    {
+        BenchmarkMipGenerators(texture);
+        return 0;
+    }
+
+    // -check runs the checks that the other ways of making and updating mips match the mips they stand in for
+    if (argc > 1 && strcmp(argv[1], "-check") == 0)
+    {
+        CheckMipDirtyRegions(texture);
+        CheckStreamingMips();
+        CheckBatchMipClamping(texture);
+        CheckNestedParallelCalls();
+        CheckLinearBatchSampling<RGBF32>(texture, "RGBF32");
+        CheckLinearBatchSampling<RGBF16>(texture, "RGBF16");
+        CheckTexelAddressing(texture);
+        CheckFixedPointBatchSampling(texture);
+        CheckAffineUVs(texture);
+        return 0;
     }
-    SaveMips(texture, "out/mips.png");
+
+    if (argc > 1 && strcmp(argv[1], "-lazymips") == 0)
+    {
+        TestLazyMips(texture);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-benchlayouts") == 0)
+    {
+        BenchmarkTexelLayouts(texture);
+        return 0;
+    }
+
+    // -cachesim [line size] [ways] [capacity in KB] [rowmajor|tiled|morton] runs the tests below through a
+    // cache model instead of saving images
+    bool cacheSim = argc > 1 && strcmp(argv[1], "-cachesim") == 0;
+    CacheConfig cacheConfig;
+    if (cacheSim)
+    {
+        if (argc > 2)
+            cacheConfig.lineSize = std::max(atoi(argv[2]), 1);
+        if (argc > 3)
+            cacheConfig.ways = std::max(atoi(argv[3]), 1);
+        if (argc > 4)
+            cacheConfig.capacity = std::max(atoi(argv[4]), 1) * 1024;
+        if (argc > 5 && strcmp(argv[5], "tiled") == 0)
+            ConvertTexelLayout(texture, TexelLayout::Tiled);
+        else if (argc > 5 && strcmp(argv[5], "morton") == 0)
+            ConvertTexelLayout(texture, TexelLayout::Morton);
+        printf("cache: %i byte lines, %i ways, %i KB, %s texels\n", cacheConfig.lineSize, cacheConfig.ways, cacheConfig.capacity / 1024, argc > 5 ? argv[5] : "rowmajor");
+    }
+
+    auto RunTest = [&](const Matrix33& uvtransform, int width, int height, const char* fileName)
+    {
+        if (cacheSim)
+            ReportTexelCache(texture, uvtransform, width, height, fileName, cacheConfig);
+        else
+            TestMipMatrix(texture, uvtransform, width, height, fileName);
+    };
+
+    // cache sim mode may have reordered the texels in place, and doesn't save images anyway
+    if (!cacheSim)
+        SaveMips(texture, "out/mips.png");
 
     // test subpixel translation: shows the usefulness of pixel interpolation (make a gif)
     // TODO: a value of 0.5 makes most pixel shifts but not all. so i tried 0.75 and it didn't really show anything compelling
     // TODO: maybe just have a slow translation of like tens of pixels over a second or two - on a sine wave?
     {
-        TestMipMatrix(texture, c_identity33, texture[0].width, texture[0].height, "out/translation0.png");
+        RunTest(c_identity33, texture[0].width, texture[0].height, "out/translation0.png");
         float translateX = 0.75f / float(texture[0].width);
-        TestMipMatrix(texture, Translate33({ translateX, 0.0f }), texture[0].width, texture[0].height, "out/translation1.png");
+        RunTest(Translate33({ translateX, 0.0f }), texture[0].width, texture[0].height, "out/translation1.png");
     }
 
 
@@ -227,27 +1331,98 @@ int main(int argc, char **argv)
     {
         Matrix33 mat = Scale33({ 3.0f, 1.0f, 1.0f });
 
-        TestMipMatrix(texture, mat, texture[0].width, texture[0].height,"out/scale.png");
+        RunTest(mat, texture[0].width, texture[0].height,"out/scale.png");
+
+        if (!cacheSim)
+        {
+            TestAnisotropic(texture, mat, texture[0].width, texture[0].height, "out/scaleaniso.png");
+            TestAnisotropic(texture, Scale33({ 16.0f, 1.0f, 1.0f }), texture[0].width, texture[0].height, "out/scale16aniso.png");
+
+            RipMaps ripMaps(&texture[0].pixels[0].r, texture[0].width, texture[0].height);
+            TestRipMap(ripMaps, texture, mat, texture[0].width, texture[0].height, "out/scaleripmap.png");
+            TestRipMap(ripMaps, texture, Scale33({ 16.0f, 1.0f, 1.0f }), texture[0].width, texture[0].height, "out/scale16ripmap.png");
+            TestRipMap(ripMaps, texture, Scale33({ 1.0f, 8.0f, 1.0f }), texture[0].width, texture[0].height, "out/scale8vripmap.png");
+
+            SummedAreaTable summedAreaTable;
+            summedAreaTable.Build(texture[0]);
+            TestSummedAreaTable(summedAreaTable, texture, mat, texture[0].width, texture[0].height, "out/scalesat.png");
+            TestSummedAreaTable(summedAreaTable, texture, Scale33({ 16.0f, 1.0f, 1.0f }), texture[0].width, texture[0].height, "out/scale16sat.png");
+        }
     }
 
     // test rotation
     {
         Matrix33 mat = Rotation33(DegreesToRadians(90.0f));
-        TestMipMatrix(texture, mat, texture[0].width, texture[0].height, "out/rot90.png");
+        RunTest(mat, texture[0].width, texture[0].height, "out/rot90.png");
 
         mat = Rotation33(DegreesToRadians(20.0f));
-        TestMipMatrix(texture, mat, texture[0].width, texture[0].height, "out/rot20.png");
+        RunTest(mat, texture[0].width, texture[0].height, "out/rot20.png");
 
         mat = Rotation33(DegreesToRadians(20.0f));
-        TestMipMatrix(texture, mat, texture[0].width*2, texture[0].height*2, "out/rot20large.png");
+        RunTest(mat, texture[0].width*2, texture[0].height*2, "out/rot20large.png");
+
+        if (!cacheSim)
+        {
+            TestEWA(texture, Rotation33(DegreesToRadians(20.0f)), texture[0].width, texture[0].height, "out/rot20ewa.png");
+            TestEWA(texture, Scale33({ 6.0f, 2.0f, 1.0f }) * Rotation33(DegreesToRadians(20.0f)), texture[0].width, texture[0].height, "out/rot20scaleewa.png");
+        }
 
         // TODO: figure out how to make sure the multiplication order is correct inside TestMipMatrix
     }
 
+    // the rotation test again with linear texel formats, which filter in linear space and sample without
+    // decoding, for 2x or 4x the memory. The times printed compare against rot20 above, which is RGBU8.
+    if (!cacheSim)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        ImageMipsT<RGBF32> textureF32;
+        MakeMips(textureF32, &texture[0].pixels[0].r, texture[0].width, texture[0].height);
+        double f32Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        ImageMipsT<RGBF16> textureF16;
+        MakeMips(textureF16, &texture[0].pixels[0].r, texture[0].width, texture[0].height);
+        double f16Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("linear mips: RGBF32 %zu KB made in %0.2fms, RGBF16 %zu KB made in %0.2fms, RGBU8 is %zu KB\n",
+            textureF32.DataSize() / 1024, f32Milliseconds, textureF16.DataSize() / 1024, f16Milliseconds, texture.DataSize() / 1024);
+
+        Matrix33 mat = Rotation33(DegreesToRadians(20.0f));
+        TestMipMatrix(textureF32, mat, texture[0].width, texture[0].height, "out/rot20f32.png");
+        TestMipMatrix(textureF16, mat, texture[0].width, texture[0].height, "out/rot20f16.png");
+    }
+
     // test mip translation
     {
         Matrix33 mat = Translate33({0.2f, 0.2f});
-        TestMipMatrix(texture, mat, texture[0].width, texture[0].height,"out/translation.png");
+        RunTest(mat, texture[0].width, texture[0].height,"out/translation.png");
+    }
+
+    // test mappings that aren't affine, where the mip changes across the image
+    if (!cacheSim)
+    {
+        // a floor going off into the distance, with the horizon just above the top of the image
+        Matrix33 perspective =
+        {
+            {
+                {2.0f, 0.0f, 0.0f},
+                {0.0f, 0.0f, 1.0f},
+                {-1.0f, 4.0f, 0.1f},
+            }
+        };
+        TestQuadMapping(texture, perspective, texture[0].width, texture[0].height, "out/perspective.png");
+
+        // a swirl, which shrinks the texture towards the middle
+        auto swirl = [](const Vector2& percent)
+        {
+            float offsetX = percent[0] - 0.5f;
+            float offsetY = percent[1] - 0.5f;
+            float radius = std::sqrtf(offsetX * offsetX + offsetY * offsetY);
+            float angle = std::atan2(offsetY, offsetX) + 4.0f * (0.7f - radius);
+            float scale = 1.0f + 4.0f * std::max(0.5f - radius, 0.0f);
+            return Vector2{ 0.5f + std::cosf(angle) * radius * scale, 0.5f + std::sinf(angle) * radius * scale };
+        };
+        TestQuadMapping(texture, swirl, texture[0].width, texture[0].height, "out/swirl.png");
     }
 
     // TODO: srgb correction on load and save? maybe work in floats until save time too.
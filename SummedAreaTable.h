@@ -0,0 +1,186 @@
+#pragma once
+
+#include "Images.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+// A summed area table of an image, which can average any axis aligned rectangle of texels in four fetches,
+// no matter how big the rectangle is. This is for heavy minification with footprints that don't fit mips
+// well, where trilinear is too blurry and anisotropic sampling needs too many taps.
+//
+// Entry (x, y) holds the sum of every texel in [0, x) x [0, y), so the table is one bigger than the image on
+// each axis, with zeros along the top and left. The sum of a rectangle is then
+//   S(x1, y1) - S(x0, y1) - S(x1, y0) + S(x0, y0)
+//
+// Texels are summed as they are stored, so RGBU8 is averaged in sRGB space, the same as the other samplers
+// filter it.
+//
+// The sums can be uint32 or double. uint32 sums wrap around on big images, but the arithmetic above is
+// modulo 2^32 too, so the sum of a rectangle still comes out right as long as the rectangle itself has less
+// than 2^32 / 255 (about 16 million) texels. double sums are exact for any image that fits in memory, for
+// twice the memory.
+template <typename SUM>
+class SummedAreaTableT
+{
+public:
+    struct Sums
+    {
+        SUM r = 0;
+        SUM g = 0;
+        SUM b = 0;
+    };
+
+    // Builds the table for an image, like mip 0 of an ImageMips. Rows are summed in parallel, and then
+    // bands of columns are summed down the table in parallel.
+    void Build(const Image& image, ThreadPool& threadPool = GetThreadPool())
+    {
+        m_width = image.width;
+        m_height = image.height;
+        m_stride = size_t(m_width) + 1;
+        m_sums.assign(m_stride * (size_t(m_height) + 1), Sums());
+
+        // prefix sums along each row
+        int bandSize = std::max(m_height / (threadPool.ThreadCount() * 4), 1);
+        threadPool.ParallelFor(m_height, bandSize,
+            [&](int yBegin, int yEnd)
+            {
+                for (int y = yBegin; y < yEnd; ++y)
+                {
+                    Sums* row = &m_sums[(size_t(y) + 1) * m_stride];
+                    for (int x = 0; x < m_width; ++x)
+                    {
+                        const RGBU8& texel = image.pixels[TexelIndex(image, x, y)];
+                        row[x + 1].r = row[x].r + SUM(texel.r);
+                        row[x + 1].g = row[x].g + SUM(texel.g);
+                        row[x + 1].b = row[x].b + SUM(texel.b);
+                    }
+                }
+            }
+        );
+
+        // then prefix sums down each column. Each band walks down the rows a band wide, so it reads and writes
+        // runs of memory instead of striding through a column at a time.
+        int columnBandSize = std::max(int(m_stride) / (threadPool.ThreadCount() * 4), 64);
+        threadPool.ParallelFor(int(m_stride), columnBandSize,
+            [&](int xBegin, int xEnd)
+            {
+                for (int y = 1; y < m_height; ++y)
+                {
+                    const Sums* above = &m_sums[size_t(y) * m_stride];
+                    Sums* row = &m_sums[(size_t(y) + 1) * m_stride];
+                    for (int x = xBegin; x < xEnd; ++x)
+                    {
+                        row[x].r += above[x].r;
+                        row[x].g += above[x].g;
+                        row[x].b += above[x].b;
+                    }
+                }
+            }
+        );
+    }
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    bool empty() const { return m_sums.empty(); }
+
+    // the sum of [0, x) x [0, y), for x in [0, width] and y in [0, height]
+    const Sums& Sum(int x, int y) const
+    {
+        return m_sums[size_t(y) * m_stride + x];
+    }
+
+    // The sum of [0, x) x [0, y) for any x and y, as if the image repeated forever. Inside of the table this
+    // is a single fetch. Outside of it, the whole copies of the image that get crossed are added from the
+    // totals along the right and bottom edges of the table.
+    Sums WrappedSum(int x, int y) const
+    {
+        if (x >= 0 && x <= m_width && y >= 0 && y <= m_height)
+            return Sum(x, y);
+
+        int wholeX = FloorDivide(x, m_width);
+        int wholeY = FloorDivide(y, m_height);
+        int restX = x - wholeX * m_width;
+        int restY = y - wholeY * m_height;
+
+        const Sums& total = Sum(m_width, m_height);
+        const Sums& columns = Sum(restX, m_height);
+        const Sums& rows = Sum(m_width, restY);
+        const Sums& rest = Sum(restX, restY);
+
+        SUM wholeXY = SUM(wholeX) * SUM(wholeY);
+        Sums ret;
+        ret.r = wholeXY * total.r + SUM(wholeX) * rows.r + SUM(wholeY) * columns.r + rest.r;
+        ret.g = wholeXY * total.g + SUM(wholeX) * rows.g + SUM(wholeY) * columns.g + rest.g;
+        ret.b = wholeXY * total.b + SUM(wholeX) * rows.b + SUM(wholeY) * columns.b + rest.b;
+        return ret;
+    }
+
+    // the sum of the texels in [x0, x1) x [y0, y1), wrapping around the edges of the image
+    Sums RectSum(int x0, int y0, int x1, int y1) const
+    {
+        Sums s00 = WrappedSum(x0, y0);
+        Sums s10 = WrappedSum(x1, y0);
+        Sums s01 = WrappedSum(x0, y1);
+        Sums s11 = WrappedSum(x1, y1);
+
+        Sums ret;
+        ret.r = s11.r - s10.r - s01.r + s00.r;
+        ret.g = s11.g - s10.g - s01.g + s00.g;
+        ret.b = s11.b - s10.b - s01.b + s00.b;
+        return ret;
+    }
+
+    size_t MemoryUsed() const { return m_sums.size() * sizeof(Sums); }
+
+private:
+    // rounds towards negative infinity, unlike integer division
+    static int FloorDivide(int value, int divisor)
+    {
+        int ret = value / divisor;
+        return (value % divisor < 0) ? ret - 1 : ret;
+    }
+
+    int m_width = 0;
+    int m_height = 0;
+    size_t m_stride = 0;
+    std::vector<Sums> m_sums;
+};
+
+typedef SummedAreaTableT<uint32_t> SummedAreaTable;
+typedef SummedAreaTableT<double> SummedAreaTableDouble;
+
+// Averages the texels in a box centered on the uv, with the size of the box given in uvs. The edges of the
+// box are rounded to the nearest texel edge, and the box is always at least one texel on each axis. Wraps
+// like the other samplers.
+template <typename SUM>
+inline RGBU8 SampleBox(const SummedAreaTableT<SUM>& table, const Vector2& uv, const Vector2& footprintSize)
+{
+    float centerX = uv[0] * float(table.Width());
+    float centerY = uv[1] * float(table.Height());
+    float halfWidth = std::fabsf(footprintSize[0]) * float(table.Width()) * 0.5f;
+    float halfHeight = std::fabsf(footprintSize[1]) * float(table.Height()) * 0.5f;
+
+    int x0 = int(std::floorf(centerX - halfWidth + 0.5f));
+    int y0 = int(std::floorf(centerY - halfHeight + 0.5f));
+    int x1 = std::max(int(std::floorf(centerX + halfWidth + 0.5f)), x0 + 1);
+    int y1 = std::max(int(std::floorf(centerY + halfHeight + 0.5f)), y0 + 1);
+
+    typename SummedAreaTableT<SUM>::Sums sum = table.RectSum(x0, y0, x1, y1);
+    double scale = 1.0 / (double(x1 - x0) * double(y1 - y0));
+
+    RGBU8 ret;
+    ret.r = uint8(double(sum.r) * scale + 0.5);
+    ret.g = uint8(double(sum.g) * scale + 0.5);
+    ret.b = uint8(double(sum.b) * scale + 0.5);
+    return ret;
+}
+
+// The box a pixel covers, as a size in uvs, given how its uv changes per pixel on x and y
+inline Vector2 BoxFootprint(const Vector2& d_uv_dx, const Vector2& d_uv_dy)
+{
+    return Vector2{ std::fabsf(d_uv_dx[0]) + std::fabsf(d_uv_dy[0]), std::fabsf(d_uv_dx[1]) + std::fabsf(d_uv_dy[1]) };
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "Images.h"
+
+#include <stdint.h>
+#include <vector>
+
+typedef uint64_t uint64;
+
+// Measures how sampling hits memory, by feeding the address of every texel the samplers read into a model
+// of a set associative cache. This is for choosing texel layouts and tile sizes from numbers instead of
+// guesses.
+//
+// Usage is to Begin() recording on a mip chain, sample it on the same thread, then End() and read the stats
+// for each mip. Reads from anywhere other than that mip chain go through the cache, but aren't counted.
+
+struct CacheConfig
+{
+    int lineSize = 64;
+    int ways = 8;
+    int capacity = 32 * 1024;
+};
+
+struct CacheStats
+{
+    uint64 texelReads = 0;
+    uint64 lineReads = 0;   // a texel that straddles two lines reads both
+    uint64 hits = 0;
+    uint64 misses = 0;
+    uint64 bytesFetched = 0;
+
+    CacheStats& operator += (const CacheStats& other)
+    {
+        texelReads += other.texelReads;
+        lineReads += other.lineReads;
+        hits += other.hits;
+        misses += other.misses;
+        bytesFetched += other.bytesFetched;
+        return *this;
+    }
+};
+
+// A set associative cache with least recently used replacement. It only tracks which lines are in it.
+class CacheModel
+{
+public:
+    explicit CacheModel(const CacheConfig& config)
+        : m_config(config)
+    {
+        m_setCount = std::max(config.capacity / (config.lineSize * config.ways), 1);
+        m_tags.resize(size_t(m_setCount) * config.ways);
+        m_lastUse.resize(m_tags.size());
+        Clear();
+    }
+
+    void Clear()
+    {
+        std::fill(m_tags.begin(), m_tags.end(), c_emptyTag);
+        std::fill(m_lastUse.begin(), m_lastUse.end(), 0);
+        m_time = 0;
+    }
+
+    // returns true if the line was already in the cache
+    bool Access(uint64 lineAddress)
+    {
+        size_t setStart = size_t(lineAddress % uint64(m_setCount)) * m_config.ways;
+        ++m_time;
+
+        int leastRecent = 0;
+        for (int way = 0; way < m_config.ways; ++way)
+        {
+            if (m_tags[setStart + way] == lineAddress)
+            {
+                m_lastUse[setStart + way] = m_time;
+                return true;
+            }
+            if (m_lastUse[setStart + way] < m_lastUse[setStart + leastRecent])
+                leastRecent = way;
+        }
+
+        m_tags[setStart + leastRecent] = lineAddress;
+        m_lastUse[setStart + leastRecent] = m_time;
+        return false;
+    }
+
+    const CacheConfig& Config() const { return m_config; }
+
+private:
+    static const uint64 c_emptyTag = ~uint64(0);
+
+    CacheConfig m_config;
+    int m_setCount = 1;
+    std::vector<uint64> m_tags;
+    std::vector<uint64> m_lastUse;
+    uint64 m_time = 0;
+};
+
+class TexelCacheSimulator
+{
+public:
+    explicit TexelCacheSimulator(const CacheConfig& config = CacheConfig())
+        : m_cache(config)
+    {
+    }
+
+    TexelCacheSimulator(const TexelCacheSimulator&) = delete;
+    TexelCacheSimulator& operator = (const TexelCacheSimulator&) = delete;
+
+    ~TexelCacheSimulator()
+    {
+        End();
+    }
+
+    // Starts recording the texel reads of this thread, with an empty cache and zeroed stats.
+    template <typename TEXEL>
+    void Begin(const ImageMipsT<TEXEL>& mips)
+    {
+        End();
+
+        m_mipRanges.clear();
+        for (const ImageT<TEXEL>& image : mips)
+        {
+            uintptr_t begin = uintptr_t(image.pixels.data());
+            m_mipRanges.push_back(MipRange{ begin, begin + image.pixels.size() * sizeof(TEXEL) });
+        }
+        m_stats.assign(mips.size(), CacheStats());
+        m_cache.Clear();
+
+        TexelReadHook& hook = CurrentTexelReadHook();
+        m_previousHook = hook;
+        hook.callback = &TexelCacheSimulator::OnTexelRead;
+        hook.context = this;
+        m_recording = true;
+    }
+
+    void End()
+    {
+        if (!m_recording)
+            return;
+
+        CurrentTexelReadHook() = m_previousHook;
+        m_recording = false;
+    }
+
+    // stats for each mip
+    const std::vector<CacheStats>& Stats() const { return m_stats; }
+
+    CacheStats Total() const
+    {
+        CacheStats ret;
+        for (const CacheStats& stats : m_stats)
+            ret += stats;
+        return ret;
+    }
+
+    const CacheConfig& Config() const { return m_cache.Config(); }
+
+private:
+    struct MipRange
+    {
+        uintptr_t begin;
+        uintptr_t end;
+    };
+
+    static void OnTexelRead(void* context, const void* address, size_t size)
+    {
+        TexelCacheSimulator& simulator = *(TexelCacheSimulator*)context;
+        uintptr_t begin = uintptr_t(address);
+
+        int mipIndex = -1;
+        for (size_t rangeIndex = 0; rangeIndex < simulator.m_mipRanges.size(); ++rangeIndex)
+        {
+            if (begin >= simulator.m_mipRanges[rangeIndex].begin && begin < simulator.m_mipRanges[rangeIndex].end)
+            {
+                mipIndex = int(rangeIndex);
+                break;
+            }
+        }
+
+        CacheStats unused;
+        CacheStats& stats = (mipIndex >= 0) ? simulator.m_stats[mipIndex] : unused;
+        stats.texelReads++;
+
+        uint64 lineSize = uint64(simulator.m_cache.Config().lineSize);
+        for (uint64 line = begin / lineSize; line <= (begin + size - 1) / lineSize; ++line)
+        {
+            stats.lineReads++;
+            if (simulator.m_cache.Access(line))
+            {
+                stats.hits++;
+            }
+            else
+            {
+                stats.misses++;
+                stats.bytesFetched += lineSize;
+            }
+        }
+    }
+
+    CacheModel m_cache;
+    std::vector<MipRange> m_mipRanges;
+    std::vector<CacheStats> m_stats;
+    TexelReadHook m_previousHook;
+    bool m_recording = false;
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+// A persistent pool of worker threads. Work is handed out as bands of an index range, or as tasks that idle
+// threads steal from busy ones, and the calling thread works on the job too, so a pool of N threads has N-1
+// workers.
+class ThreadPool
+{
+public:
+    // a thread count of 0 means to use std::thread::hardware_concurrency()
+    explicit ThreadPool(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(int(std::thread::hardware_concurrency()), 1);
+
+        for (int i = 1; i < threadCount; ++i)
+            m_threads.emplace_back([this]() { WorkerThread(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeCV.notify_all();
+        for (std::thread& thread : m_threads)
+            thread.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    int ThreadCount() const
+    {
+        return int(m_threads.size()) + 1;
+    }
+
+    // Calls fn(begin, end) for bands of at most bandSize indices covering [0, count), and returns once all
+    // of them are done. Calls made from inside of a band run serially on the calling thread.
+    void ParallelFor(int count, int bandSize, const std::function<void(int, int)>& fn)
+    {
+        if (count <= 0)
+            return;
+
+        bandSize = std::max(bandSize, 1);
+        int bandCount = (count + bandSize - 1) / bandSize;
+
+        if (m_threads.empty() || bandCount == 1 || JobDepth() > 0)
+        {
+            for (int begin = 0; begin < count; begin += bandSize)
+                fn(begin, std::min(begin + bandSize, count));
+            return;
+        }
+
+        Job job;
+        job.fn = &fn;
+        job.count = count;
+        job.bandSize = bandSize;
+        RunJob(job);
+    }
+
+    // Calls fn(index) for every index in [0, count), and returns once all of them are done. This is for tasks
+    // that take uneven amounts of time, like tiles of an image. Each thread starts with its own contiguous run
+    // of indices, and a thread that runs out steals the back half of the run of another thread, so the slow
+    // tasks get spread out without every task being claimed through one shared counter. Which thread runs
+    // each index isn't deterministic, so each task should only write its own part of the results. Calls made
+    // from inside of a task run serially on the calling thread.
+    void ParallelForTasks(int count, const std::function<void(int)>& fn)
+    {
+        if (count <= 0)
+            return;
+
+        if (m_threads.empty() || count == 1 || JobDepth() > 0)
+        {
+            for (int index = 0; index < count; ++index)
+                fn(index);
+            return;
+        }
+
+        int rangeCount = ThreadCount();
+        std::unique_ptr<TaskRange[]> ranges(new TaskRange[rangeCount]);
+        for (int rangeIndex = 0; rangeIndex < rangeCount; ++rangeIndex)
+        {
+            ranges[rangeIndex].begin = int(int64_t(count) * rangeIndex / rangeCount);
+            ranges[rangeIndex].end = int(int64_t(count) * (rangeIndex + 1) / rangeCount);
+        }
+
+        Job job;
+        job.taskFn = &fn;
+        job.ranges = ranges.get();
+        job.rangeCount = rangeCount;
+        RunJob(job);
+    }
+
+private:
+    // a run of task indices that one thread owns, which other threads can steal from the back of
+    struct TaskRange
+    {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    // either bands of an index range, or tasks with work stealing when taskFn is set
+    struct Job
+    {
+        const std::function<void(int, int)>* fn = nullptr;
+        int count = 0;
+        int bandSize = 0;
+        std::atomic<int> nextBegin = { 0 };
+
+        const std::function<void(int)>* taskFn = nullptr;
+        TaskRange* ranges = nullptr;
+        int rangeCount = 0;
+        std::atomic<int> nextRange = { 0 };
+    };
+
+    // How many jobs this thread is working on inside of each other. Worker threads and the thread that
+    // started a job both count, so a nested call from either of them runs serially, instead of waiting on a
+    // job that can't finish until the call returns.
+    static int& JobDepth()
+    {
+        static thread_local int s_jobDepth = 0;
+        return s_jobDepth;
+    }
+
+    // hands the job to the workers, works on it on this thread too, and waits for it to be done
+    void RunJob(Job& job)
+    {
+        // only one job runs on the pool at a time
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_jobGeneration++;
+        }
+        m_wakeCV.notify_all();
+
+        WorkOnJob(job);
+
+        // all of the work has been claimed, so wait for the workers that are still running theirs
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCV.wait(lock, [this]() { return m_busyWorkers == 0; });
+        m_job = nullptr;
+    }
+
+    static void WorkOnJob(Job& job)
+    {
+        JobDepth()++;
+        if (job.taskFn)
+            RunTasks(job, job.nextRange.fetch_add(1));
+        else
+            RunBands(job);
+        JobDepth()--;
+    }
+
+    static void RunBands(Job& job)
+    {
+        while (true)
+        {
+            int begin = job.nextBegin.fetch_add(job.bandSize);
+            if (begin >= job.count)
+                return;
+            (*job.fn)(begin, std::min(begin + job.bandSize, job.count));
+        }
+    }
+
+    // Runs the tasks of its own range from the front, and steals more once that's empty. This returns once
+    // there's nothing left to steal, which means every task has been claimed by some thread.
+    static void RunTasks(Job& job, int rangeIndex)
+    {
+        TaskRange& own = job.ranges[rangeIndex];
+        while (true)
+        {
+            int index = -1;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (own.begin < own.end)
+                    index = own.begin++;
+            }
+
+            if (index >= 0)
+                (*job.taskFn)(index);
+            else if (!StealTasks(job, rangeIndex))
+                return;
+        }
+    }
+
+    // moves the back half of the first range found with tasks left into the empty range of this thread
+    static bool StealTasks(Job& job, int rangeIndex)
+    {
+        for (int offset = 1; offset < job.rangeCount; ++offset)
+        {
+            TaskRange& victim = job.ranges[(rangeIndex + offset) % job.rangeCount];
+
+            int stolenBegin, stolenEnd;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                int remaining = victim.end - victim.begin;
+                if (remaining <= 0)
+                    continue;
+                stolenEnd = victim.end;
+                stolenBegin = victim.end - (remaining + 1) / 2;
+                victim.end = stolenBegin;
+            }
+
+            TaskRange& own = job.ranges[rangeIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = stolenBegin;
+            own.end = stolenEnd;
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerThread()
+    {
+        uint64_t lastJobGeneration = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wakeCV.wait(lock, [&]() { return m_quit || (m_job && m_jobGeneration != lastJobGeneration); });
+            if (m_quit)
+                return;
+
+            lastJobGeneration = m_jobGeneration;
+            Job* job = m_job;
+            m_busyWorkers++;
+
+            lock.unlock();
+            WorkOnJob(*job);
+            lock.lock();
+
+            m_busyWorkers--;
+            if (m_busyWorkers == 0)
+                m_doneCV.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_jobMutex;
+
+    // everything below is protected by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCV;
+    std::condition_variable m_doneCV;
+    Job* m_job = nullptr;
+    uint64_t m_jobGeneration = 0;
+    int m_busyWorkers = 0;
+    bool m_quit = false;
+};
+
+// The thread count of the shared pool can be set before the first call to GetThreadPool(). After that it
+// has no effect. 0 means to use the hardware concurrency.
+inline int& ThreadPoolThreadCountSetting()
+{
+    static int s_threadCount = 0;
+    return s_threadCount;
+}
+
+inline ThreadPool& GetThreadPool()
+{
+    static ThreadPool s_threadPool(ThreadPoolThreadCountSetting());
+    return s_threadPool;
+}